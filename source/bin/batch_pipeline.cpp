@@ -0,0 +1,315 @@
+// Headless pipeline from a model to cutting patterns, no viewer is created:
+// split into parts, cut, heuristic steps, intersect with the model and export a pattern per part.
+// usage: batch_pipeline [-o output_dir] [-f svg,dxf] [-s scale] [-n steps,...] [-h h,...] [-u u0_ratio,...] model.obj...
+// Every combination of the listed values is a parameter set and every model is processed with
+// every set. These jobs run concurrently on the shared ThreadPool, a single job uses it for its parts.
+// The patterns go to output_dir/<model>/<set>/part<i>.svg and/or .dxf, the timings of every job as JSON to
+// output_dir/batch_pipeline.json, progress goes to stderr.
+
+#include "common/common.h"
+#include "common/thread_pool.h"
+
+#include "model/data_model.h"
+#include "output/export_pattern.h"
+
+#include <igl/readOBJ.h>
+#include <igl/facet_components.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	namespace fs = std::filesystem;
+	using model::DataModel;
+	using model::ModelPart;
+
+	struct ParameterSet {
+		int steps;
+		real h;
+		real u0_ratio;
+
+		string name() const {
+			std::ostringstream res;
+			res << "n" << steps << "_h" << h << "_u" << u0_ratio;
+			return res.str();
+		}
+	};
+
+	struct Job {
+		string model;
+		ParameterSet parameters;
+
+		// seconds per stage
+		real load = 0., parts = 0., solve = 0., heuristic = 0., intersect = 0., output = 0.;
+		int part_count = 0;
+		string error;
+	};
+
+	const char *usage = "usage: batch_pipeline [-o output_dir] [-f svg,dxf] [-s scale] [-n steps,...] [-h h,...] [-u u0_ratio,...] model.obj...";
+
+	template<typename T>
+	vector<T> parse_list(const string &arg) {
+		vector<T> res;
+		std::istringstream in(arg);
+		string item;
+		while (std::getline(in, item, ',')) {
+			std::istringstream value(item);
+			T x;
+			if (!(value >> x)) {
+				throw std::runtime_error("invalid value in list " + arg);
+			}
+			res.push_back(x);
+		}
+		return res;
+	}
+
+	// runs f and returns the elapsed seconds
+	template<typename F>
+	real timed(F f) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration_cast<std::chrono::duration<real>>(end-start).count();
+	}
+
+	void run_job(Job &job, real scale, int formats, const fs::path &output_dir) {
+		const ParameterSet &p = job.parameters;
+		DataModel data_model;
+		data_model.do_auto_update = false;
+
+		Eigen::MatrixXd V;
+		Eigen::MatrixXi F;
+		job.load = timed([&]() {
+			if (!igl::readOBJ(job.model, V, F)) {
+				throw std::runtime_error("could not read " + job.model);
+			}
+			V *= scale;
+			data_model.target(V, F);
+		});
+
+		// the parts are cut with the default parameters, cut again with the ones of the set
+		job.parts = timed([&]() {
+			Eigen::VectorXi C;
+			igl::facet_components(data_model.target().F(), C);
+			data_model.update_parts(C, false);
+			for (auto &part : data_model.parts) {
+				part.h = p.h;
+				part.u0_ratio = p.u0_ratio;
+				Eigen::MatrixXd cutline = part.cutline();
+				part.cutline(cutline, false);
+			}
+		});
+		job.part_count = data_model.parts.size();
+
+		vector<int> all(data_model.parts.size());
+		std::iota(all.begin(), all.end(), 0);
+
+		job.solve = timed([&]() {
+			data_model.solve_parts(all);
+		});
+
+		// children first, so that every step sees the masses of the children's last step
+		job.heuristic = timed([&]() {
+			for (int i = 0; i < p.steps; i++) {
+				data_model.for_parts_bottom_up(all, [](ModelPart &part) {
+					if (part.ruffle().sections.empty()) return;
+					part.update_extra_masses();
+					part.heuristic.step(part.ruffle());
+				});
+			}
+		});
+
+		job.intersect = timed([&]() {
+			ThreadPool::instance().parallel_for(data_model.parts.size(), [&](int i) {
+				data_model.parts[i].intersect_ruffle();
+			});
+		});
+
+		fs::path dir = output_dir / fs::path(job.model).stem() / p.name();
+		job.output = timed([&]() {
+			vector<Ruffle*> ruffles;
+			for (auto &part : data_model.parts) {
+				ruffles.push_back(&part.ruffle());
+			}
+			export_patterns(ruffles, dir.string(), formats);
+		});
+	}
+
+	// JSON string literal with quotes, backslashes and control characters escaped
+	void write_string(std::ostream &out, const string &s) {
+		out << "\"";
+		for (char c : s) {
+			switch (c) {
+				case '"': out << "\\\""; break;
+				case '\\': out << "\\\\"; break;
+				case '\n': out << "\\n"; break;
+				case '\r': out << "\\r"; break;
+				case '\t': out << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						char escaped[8];
+						std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+						out << escaped;
+					} else {
+						out << c;
+					}
+			}
+		}
+		out << "\"";
+	}
+
+	void write_job(std::ostream &out, const Job &job) {
+		const ParameterSet &p = job.parameters;
+		out << "  {\"model\": ";
+		write_string(out, job.model);
+		out << ", "
+			<< "\"steps\": " << p.steps << ", "
+			<< "\"h\": " << p.h << ", "
+			<< "\"u0_ratio\": " << p.u0_ratio << ", "
+			<< "\"parts\": " << job.part_count << ", "
+			<< "\"time\": {"
+			<< "\"load\": " << job.load << ", "
+			<< "\"parts\": " << job.parts << ", "
+			<< "\"solve\": " << job.solve << ", "
+			<< "\"heuristic\": " << job.heuristic << ", "
+			<< "\"intersect\": " << job.intersect << ", "
+			<< "\"output\": " << job.output << "}, "
+			<< "\"error\": ";
+		if (job.error.empty()) {
+			out << "null";
+		} else {
+			write_string(out, job.error);
+		}
+		out << "}";
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		fs::path output_dir = "batch_output";
+		real scale = DataModel().scale;
+		vector<int> steps = {10};
+		vector<real> hs = {ModelPart::default_h};
+		vector<real> u0_ratios = {ModelPart::default_u0_ratio};
+		int formats = SVG;
+		vector<string> models;
+
+		for (int i = 1; i < argc; i++) {
+			string arg = argv[i];
+			if (arg.size() == 2 && arg[0] == '-') {
+				if (i+1 >= argc) {
+					cerr << usage << endl;
+					return 1;
+				}
+				string value = argv[++i];
+				switch (arg[1]) {
+					case 'o': output_dir = value; break;
+					case 'f':
+						formats = 0;
+						for (auto &format : parse_list<string>(value)) {
+							if (format == "svg") formats |= SVG;
+							else if (format == "dxf") formats |= DXF;
+							else throw std::runtime_error("unknown format " + format);
+						}
+						break;
+					case 's': scale = parse_list<real>(value).at(0); break;
+					case 'n': steps = parse_list<int>(value); break;
+					case 'h': hs = parse_list<real>(value); break;
+					case 'u': u0_ratios = parse_list<real>(value); break;
+					default:
+						cerr << usage << endl;
+						return 1;
+				}
+			} else {
+				models.push_back(arg);
+			}
+		}
+		if (models.empty()) {
+			cerr << usage << endl;
+			return 1;
+		}
+
+		vector<Job> jobs;
+		for (auto &model : models) {
+			for (int n : steps) {
+				for (real h : hs) {
+					for (real u0_ratio : u0_ratios) {
+						jobs.push_back({model, {n, h, u0_ratio}});
+					}
+				}
+			}
+		}
+
+		std::mutex progress_mutex;
+		int done = 0;
+		ThreadPool::instance().parallel_for(jobs.size(), [&](int i) {
+			Job &job = jobs[i];
+			try {
+				run_job(job, scale, formats, output_dir);
+			} catch (const std::exception &e) {
+				job.error = e.what();
+			}
+
+			std::lock_guard<std::mutex> lock(progress_mutex);
+			done++;
+			cerr << "[" << done << "/" << jobs.size() << "] " << job.model << " " << job.parameters.name() << ": ";
+			if (job.error.empty()) {
+				cerr << job.part_count << " parts, "
+					<< "load " << job.load << " s, "
+					<< "parts " << job.parts << " s, "
+					<< "solve " << job.solve << " s, "
+					<< "heuristic " << job.heuristic << " s, "
+					<< "intersect " << job.intersect << " s, "
+					<< "output " << job.output << " s" << endl;
+			} else {
+				cerr << "failed: " << job.error << endl;
+			}
+		});
+
+		fs::create_directories(output_dir);
+		string filename = (output_dir / "batch_pipeline.json").string();
+		std::ofstream out(filename);
+		if (!out) {
+			cerr << "Could not open " << filename << endl;
+			return 1;
+		}
+		out << std::setprecision(10);
+		out << "[\n";
+		int failed = 0;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			out << (i == 0 ? "" : ",\n");
+			write_job(out, jobs[i]);
+			failed += !jobs[i].error.empty();
+		}
+		out << "\n]\n";
+
+		if (failed > 0) {
+			cerr << failed << " of " << jobs.size() << " jobs failed" << endl;
+			return 1;
+		}
+		return 0;
+	}
+}
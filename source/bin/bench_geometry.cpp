@@ -0,0 +1,193 @@
+// Headless benchmark of the CGAL geometry: air mesh construction and relaxation,
+// the TargetShape queries and TargetShape::energy. Build with and without RUFFLES_EXACT_AIR_MESH /
+// RUFFLES_EXACT_QUERIES to compare the kernels, the latter only changes intersect_horizontal.
+// The energy is evaluated with both the exact booleans and the double precision overlap,
+// their difference is reported.
+// usage: bench_geometry [output.json]
+// To compare, run it from one build per configuration, e.g. cmake -DRUFFLES_EXACT_AIR_MESH=ON
+// -DRUFFLES_EXACT_QUERIES=ON in a second build directory; the kernels are in the output and on stderr.
+
+#include "common/common.h"
+#include "common/cgal_util.h"
+
+#include "ruffle/ruffle.h"
+#include "optimization/target_shape.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	// average wall time of f in seconds
+	template<typename F>
+	real measure(int repetitions, F f) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < repetitions; i++) {
+			f();
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration_cast<std::chrono::duration<real>>(end-start).count() / repetitions;
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		string filename = argc > 1 ? argv[1] : "bench_geometry.json";
+		std::ofstream out(filename);
+		if (!out) {
+			cerr << "Could not open " << filename << endl;
+			return 1;
+		}
+		out << std::setprecision(10);
+
+#ifdef RUFFLES_EXACT_AIR_MESH
+		const char *air_mesh_kernel = "exact";
+#else
+		const char *air_mesh_kernel = "inexact";
+#endif
+#ifdef RUFFLES_EXACT_QUERIES
+		const char *query_kernel = "exact";
+#else
+		const char *query_kernel = "inexact";
+#endif
+		cerr << "kernels: air mesh " << air_mesh_kernel << ", queries " << query_kernel << endl;
+
+		out << "{\n";
+		out << "  \"air_mesh_kernel\": \"" << air_mesh_kernel << "\",\n";
+		out << "  \"query_kernel\": \"" << query_kernel << "\",\n";
+
+		out << "  \"air_mesh\": [\n";
+		bool first = true;
+		for (real h : {0.5, 0.25, 0.125}) {
+			for (int steps : {2, 4, 8}) {
+				Ruffle ruffle = Ruffle::create_ruffle_stack(steps, 3., 5.28, h);
+				auto &mesh = ruffle.simulation_mesh;
+
+				real generate = measure(5, [&]() {
+					mesh.generate_air_mesh();
+				});
+
+				// small perturbations, as between two solver steps
+				VectorX x0 = mesh.x;
+				real relax = measure(20, [&]() {
+					mesh.x = x0 + 1e-2 * h * VectorX::Random(x0.size());
+					mesh.relax_air_mesh();
+				});
+				mesh.x = x0;
+
+				out << (first ? "" : ",\n");
+				first = false;
+				out << "    {"
+					<< "\"size\": " << steps << ", "
+					<< "\"h\": " << h << ", "
+					<< "\"vertices\": " << mesh.vertices.size() << ", "
+					<< "\"faces\": " << mesh.air_mesh.faces.size() << ", "
+					<< "\"generate\": " << generate << ", "
+					<< "\"relax\": " << relax
+					<< "}";
+				cerr << "air mesh size=" << steps << " h=" << h << ": generate " << generate * 1000. << " ms, relax " << relax * 1000. << " ms" << endl;
+			}
+		}
+		out << "\n  ],\n";
+
+		out << "  \"queries\": [\n";
+		first = true;
+		for (int n : {16, 64, 256, 1024}) {
+			Polygon circle;
+			for (int i = 0; i < n; i++) {
+				real phi = 2*M_PI*i/n;
+				circle.push_back(Point(10.*cos(phi), 10.*sin(phi)));
+			}
+			optimization::TargetShape target(circle);
+
+			constexpr int queries = 1000;
+			MatrixX points = 12. * MatrixX::Random(queries, 2);
+			real sum = 0.;
+			real signed_distance = measure(1, [&]() {
+				for (int i = 0; i < queries; i++) {
+					sum += target.signed_distance(points.row(i).transpose());
+				}
+			}) / queries;
+			real raycast = measure(1, [&]() {
+				for (int i = 0; i < queries; i++) {
+					Vector2 dir(cos(i), sin(i));
+					real t = target.raycast(points.row(i).transpose(), dir);
+					sum += std::isfinite(t) ? t : 0.;
+				}
+			}) / queries;
+			// the only query that still uses the kernel of RUFFLES_EXACT_QUERIES
+			real intersect_horizontal = measure(1, [&]() {
+				for (int i = 0; i < queries; i++) {
+					auto [left, right] = target.intersect_horizontal(points(i, 1));
+					sum += left <= right ? right - left : 0.; // empty above and below the target
+				}
+			}) / queries;
+
+			out << (first ? "" : ",\n");
+			first = false;
+			out << "    {"
+				<< "\"polygon_vertices\": " << n << ", "
+				<< "\"signed_distance\": " << signed_distance << ", "
+				<< "\"raycast\": " << raycast << ", "
+				<< "\"intersect_horizontal\": " << intersect_horizontal << ", "
+				<< "\"checksum\": " << sum
+				<< "}";
+			cerr << "queries n=" << n << ": signed_distance " << signed_distance * 1e6 << " us, raycast " << raycast * 1e6 << " us, "
+				<< "intersect_horizontal " << intersect_horizontal * 1e6 << " us" << endl;
+		}
+		out << "\n  ],\n";
+
+		out << "  \"energy\": [\n";
+		first = true;
+		for (int steps : {2, 4, 8}) {
+			Ruffle ruffle = Ruffle::create_ruffle_stack(steps, 3., 5.28, 0.25);
+			Polygon target_polygon;
+			for (int i = 0; i < 256; i++) {
+				real phi = 2*M_PI*i/256;
+				target_polygon.push_back(Point(2.64 + 4.*cos(phi), 1.5*steps + 1.5*steps*sin(phi)));
+			}
+			optimization::TargetShape target(target_polygon);
+
+			target.exact_energy = true;
+			real exact_energy = 0.;
+			real exact = measure(5, [&]() {
+				exact_energy = target.energy(ruffle);
+			});
+			target.exact_energy = false;
+			real fast_energy = 0.;
+			real fast = measure(5, [&]() {
+				fast_energy = target.energy(ruffle);
+			});
+
+			out << (first ? "" : ",\n");
+			first = false;
+			out << "    {"
+				<< "\"size\": " << steps << ", "
+				<< "\"exact\": " << exact << ", "
+				<< "\"fast\": " << fast << ", "
+				<< "\"exact_energy\": " << exact_energy << ", "
+				<< "\"fast_energy\": " << fast_energy
+				<< "}";
+			cerr << "energy size=" << steps << ": exact " << exact * 1000. << " ms, fast " << fast * 1000. << " ms, "
+				<< "difference " << abs(exact_energy - fast_energy) << endl;
+		}
+		out << "\n  ]\n";
+		out << "}\n";
+
+		return 0;
+	}
+}
@@ -0,0 +1,166 @@
+// Headless benchmark of Ruffle::physics_solve, no viewer is created.
+// usage: bench_physics_solve [output.json]
+// Results are written as JSON to the given file (default bench_physics_solve.json),
+// progress goes to stderr.
+
+#include "common/common.h"
+
+#include "ruffle/ruffle.h"
+#include "optimization/target_shape.h"
+#include "simulation/verlet.h"
+#include "simulation/lbfgs.h"
+#include "simulation/line_search.h"
+#include "simulation/combination.h"
+#include "simulation/newton.h"
+#include "simulation/fire.h"
+
+#include <fstream>
+#include <functional>
+#include <iomanip>
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	using simulation::SimulationMesh;
+	using simulation::Simulator;
+
+	struct Generator {
+		string name;
+		int size;
+		real h;
+		std::function<Ruffle()> create;
+	};
+
+	struct SimulatorFactory {
+		string name;
+		std::function<Simulator*(const SimulationMesh &)> create;
+	};
+
+	// rectangular target of the given height, the stack follows its vertical center line
+	Ruffle create_stack_in_rectangle(real height, real width, real h) {
+		Polygon target;
+		target.push_back(Point(-0.5*width, -1.));
+		target.push_back(Point( 0.5*width, -1.));
+		target.push_back(Point( 0.5*width, height+1.));
+		target.push_back(Point(-0.5*width, height+1.));
+		optimization::TargetShape target_shape(target);
+
+		MatrixX points(2, 2);
+		points <<
+			0., 0.,
+			0., height;
+		return Ruffle::create_stack_along_curve(points, target_shape, h);
+	}
+
+	vector<Generator> generators() {
+		vector<Generator> res;
+		for (real h : {0.5, 0.25}) {
+			for (int steps : {2, 4, 8}) {
+				res.push_back({"ruffle_stack", steps, h, [=]() {
+					return Ruffle::create_ruffle_stack(steps, 3., 5.28, h);
+				}});
+				res.push_back({"horizontal_stack", steps, h, [=]() {
+					return Ruffle::create_horizontal_stack(steps, 4., 3., h);
+				}});
+				res.push_back({"stack_along_curve", steps, h, [=]() {
+					return create_stack_in_rectangle(3.*steps, 6., h);
+				}});
+			}
+		}
+		return res;
+	}
+
+	vector<SimulatorFactory> simulators() {
+		return {
+			{"Verlet",      [](const SimulationMesh &mesh) -> Simulator* { return new simulation::Verlet(mesh); }},
+			{"LBFGS",       [](const SimulationMesh &mesh) -> Simulator* { return new simulation::LBFGS(mesh); }},
+			{"LineSearch",  [](const SimulationMesh &mesh) -> Simulator* { return new simulation::LineSearch(mesh); }},
+			{"Combination", [](const SimulationMesh &mesh) -> Simulator* { return new simulation::Combination(mesh); }},
+			{"Newton",      [](const SimulationMesh &mesh) -> Simulator* { return new simulation::Newton(mesh); }},
+			{"FIRE",        [](const SimulationMesh &mesh) -> Simulator* { return new simulation::FIRE(mesh); }},
+		};
+	}
+
+	// one physics solve, appended to out as a JSON object
+	void bench_solve(std::ostream &out, const Generator &gen, const SimulatorFactory &sim, Ruffle &ruffle, bool air_mesh, bool barrier) {
+		ruffle.simulation_mesh.energy_evaluations = 0;
+		ruffle.physics_solve();
+		int evaluations = ruffle.simulation_mesh.energy_evaluations;
+		real energy = ruffle.simulation_mesh.energy(ruffle.simulation_mesh.x, nullptr);
+
+		out << "  {"
+			<< "\"generator\": \"" << gen.name << "\", "
+			<< "\"size\": " << gen.size << ", "
+			<< "\"h\": " << gen.h << ", "
+			<< "\"simulator\": \"" << sim.name << "\", "
+			<< "\"air_mesh\": " << (air_mesh ? "true" : "false") << ", "
+			<< "\"barrier\": " << (barrier ? "true" : "false") << ", "
+			<< "\"dof\": " << ruffle.simulation_mesh.dof() << ", "
+			<< "\"time\": " << ruffle.last_physics_solve_time << ", "
+			<< "\"steps\": " << ruffle.last_physics_solve_steps << ", "
+			<< "\"converged\": " << (ruffle.last_physics_solve_converged ? "true" : "false") << ", "
+			<< "\"energy_evaluations\": " << evaluations << ", "
+			<< "\"energy\": ";
+		if (std::isfinite(energy)) {
+			out << energy;
+		} else {
+			out << "null";
+		}
+		out << "}";
+
+		cerr << gen.name << " size=" << gen.size << " h=" << gen.h << " " << sim.name
+			<< (barrier ? " (air mesh, barrier)" : air_mesh ? " (air mesh)" : "") << ": "
+			<< ruffle.last_physics_solve_time * 1000. << " ms, "
+			<< ruffle.last_physics_solve_steps << " steps"
+			<< (ruffle.last_physics_solve_converged ? "" : ", not converged") << endl;
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		string filename = argc > 1 ? argv[1] : "bench_physics_solve.json";
+		std::ofstream out(filename);
+		if (!out) {
+			cerr << "Could not open " << filename << endl;
+			return 1;
+		}
+		out << std::setprecision(10);
+
+		out << "[\n";
+		bool first = true;
+		for (const Generator &gen : generators()) {
+			for (const SimulatorFactory &sim : simulators()) {
+				// free solve, with the air mesh penalty like the editor does and with the barrier like ModelPart,
+				// all from the generated state
+				for (int mode = 0; mode < 3; mode++) {
+					bool air_mesh = mode > 0;
+					bool barrier = mode > 1;
+					Ruffle ruffle = gen.create();
+					ruffle.simulator.reset(sim.create(ruffle.simulation_mesh));
+					if (air_mesh) {
+						ruffle.simulation_mesh.air_mesh_barrier = barrier;
+						ruffle.simulation_mesh.generate_air_mesh();
+					}
+					out << (first ? "" : ",\n");
+					first = false;
+					bench_solve(out, gen, sim, ruffle, air_mesh, barrier);
+				}
+			}
+		}
+		out << "\n]\n";
+
+		return 0;
+	}
+}
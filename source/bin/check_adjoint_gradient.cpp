@@ -0,0 +1,104 @@
+// Checks Adjoint::gradient against central differences of TargetShape::energy,
+// every difference solves the ruffle again with a tight Newton tolerance.
+// usage: check_adjoint_gradient [tolerance]
+// tolerance is relative to the largest gradient entry (default 1e-2). Prints every section and
+// returns 1 if one of them is off by more than that.
+
+#include "common/common.h"
+
+#include "ruffle/ruffle.h"
+#include "optimization/adjoint.h"
+#include "optimization/target_shape.h"
+#include "simulation/newton.h"
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	using optimization::Adjoint;
+	using optimization::TargetShape;
+
+	// trapezoid narrowing upwards around a stack of the given width, so that the stack neither fits nor covers it
+	TargetShape create_target(real height, real width) {
+		Polygon target;
+		target.push_back(Point(-0.5*width, -1.));
+		target.push_back(Point( 1.5*width, -1.));
+		target.push_back(Point( 0.9*width, height+1.));
+		target.push_back(Point( 0.1*width, height+1.));
+		return TargetShape(target);
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		real tolerance = argc > 1 ? std::stod(argv[1]) : 1e-2;
+		constexpr int steps = 3;
+		constexpr real height = 3.;
+		constexpr real width = 5.28;
+
+		TargetShape target = create_target(steps * height, width);
+		Ruffle ruffle = Ruffle::create_ruffle_stack(steps, height, width, 0.5);
+
+		auto newton = new simulation::Newton(ruffle.simulation_mesh);
+		newton->epsilon = 1e-10;
+		ruffle.simulator.reset(newton);
+		ruffle.physics_solve();
+
+		Adjoint adjoint(target);
+		VectorX grad;
+		real energy = adjoint.gradient(ruffle, grad);
+		real scale = grad.size() ? grad.cwiseAbs().maxCoeff() : 0.;
+		cerr << "energy " << energy << ", " << grad.size() << " sections, largest gradient " << scale << endl;
+		if (grad.size() == 0 || !grad.allFinite() || scale == 0.) {
+			cerr << "FAILED: no usable gradient" << endl;
+			return 1;
+		}
+
+		auto sections = Adjoint::sections(ruffle);
+		auto energy_at = [&](Ruffle::Section &section, real length) {
+			section.length = length;
+			ruffle.update_simulation_mesh();
+			ruffle.physics_solve(true);
+			return adjoint.target.energy(ruffle);
+		};
+
+		int failures = 0;
+		for (size_t s = 0; s < sections.size(); s++) {
+			Ruffle::Section &section = *sections[s];
+			real length = section.length;
+			real h = 1e-4 * length;
+
+			real plus = energy_at(section, length + h);
+			real minus = energy_at(section, length - h);
+			energy_at(section, length);
+			real fd = (plus - minus) / (2.*h);
+
+			real error = std::abs(fd - grad(s)) / scale;
+			bool ok = error <= tolerance;
+			failures += !ok;
+			cerr << "section " << s << ": adjoint " << grad(s) << ", finite difference " << fd
+				<< ", error " << error << (ok ? "" : "  FAILED") << endl;
+		}
+
+		if (failures > 0) {
+			cerr << failures << " of " << sections.size() << " section(s) above the tolerance " << tolerance << endl;
+			return 1;
+		}
+		cerr << "all sections within " << tolerance << endl;
+		return 0;
+	}
+}
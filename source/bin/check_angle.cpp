@@ -0,0 +1,127 @@
+// Checks the batched angle() against the scalar one on random and near-degenerate corners.
+// usage: check_angle [tolerance]
+// tolerance bounds the error of theta and of the gradient relative to the largest entry of the scalar
+// gradient of the corner (default 1e-8, the gradient of nearly straight corners is around 1e6).
+// Prints the worst error of every case, returns 1 if one is above the tolerance.
+
+#include "common/common.h"
+
+#include <functional>
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	struct Case {
+		string name;
+		// corner i of the case, the points p0, p1, p2 of angle()
+		std::function<Vector6(int i, std::mt19937 &rng)> corner;
+	};
+
+	Vector2 random_point(std::mt19937 &rng) {
+		return 2. * random_vector(2, rng).array() - 1.;
+	}
+
+	// p1 at the origin, p0 and p2 at the given lengths and angle between them, rotated randomly
+	Vector6 corner_with_angle(real theta, real l1, real l2, std::mt19937 &rng) {
+		real rotation = 2. * M_PI * random_vector(1, rng)(0);
+		Vector2 d0(cos(rotation), sin(rotation));
+		Vector2 d2(cos(rotation + theta), sin(rotation + theta));
+		Vector2 offset = random_point(rng);
+		Vector6 res;
+		res << offset + l1 * d0, offset, offset + l2 * d2;
+		return res;
+	}
+
+	vector<Case> cases() {
+		vector<Case> res;
+		res.push_back({"random", [](int, std::mt19937 &rng) {
+			Vector6 res;
+			res << random_point(rng), random_point(rng), random_point(rng);
+			return res;
+		}});
+		for (int exponent : {3, 6, 9}) {
+			real eps = std::pow(10., -exponent);
+			string suffix = " 1e-" + to_string(exponent);
+			res.push_back({"nearly straight" + suffix, [=](int, std::mt19937 &rng) {
+				return corner_with_angle(M_PI - eps, 1., 1., rng);
+			}});
+			res.push_back({"nearly folded" + suffix, [=](int, std::mt19937 &rng) {
+				return corner_with_angle(eps, 1., 1., rng);
+			}});
+		}
+		res.push_back({"exactly straight", [](int, std::mt19937 &rng) {
+			return corner_with_angle(M_PI, 1., 1., rng);
+		}});
+		res.push_back({"short edges", [](int, std::mt19937 &rng) {
+			return corner_with_angle(M_PI * random_vector(1, rng)(0), 1e-6, 1e-6, rng);
+		}});
+		res.push_back({"long edges", [](int, std::mt19937 &rng) {
+			return corner_with_angle(M_PI * random_vector(1, rng)(0), 1e3, 1e3, rng);
+		}});
+		res.push_back({"unequal edges", [](int i, std::mt19937 &rng) {
+			real ratio = i % 2 ? 1e-5 : 1e5;
+			return corner_with_angle(M_PI * random_vector(1, rng)(0), 1., ratio, rng);
+		}});
+		return res;
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		real tolerance = argc > 1 ? std::stod(argv[1]) : 1e-8;
+		constexpr int corners = 4096;
+		std::mt19937 rng(1234);
+
+		int failures = 0;
+		for (const Case &c : cases()) {
+			MatrixX6 x(corners, 6);
+			for (int i = 0; i < corners; i++) {
+				x.row(i) = c.corner(i, rng).transpose();
+			}
+
+			VectorX theta;
+			MatrixX6 grad;
+			angle(x, theta, &grad);
+
+			real theta_error = 0., grad_error = 0.;
+			for (int i = 0; i < corners; i++) {
+				Vector6 scalar_grad;
+				real scalar_theta = angle(Vector6(x.row(i).transpose()), &scalar_grad);
+				real scale = max(1., scalar_grad.cwiseAbs().maxCoeff());
+
+				// NaN compares false, so it counts as infinitely wrong
+				real e_theta = std::abs(theta(i) - scalar_theta);
+				real e_grad = (grad.row(i).transpose() - scalar_grad).cwiseAbs().maxCoeff() / scale;
+				theta_error = std::isnan(e_theta) ? infinity : max(theta_error, e_theta);
+				grad_error = std::isnan(e_grad) ? infinity : max(grad_error, e_grad);
+			}
+
+			bool ok = theta_error <= tolerance && grad_error <= tolerance;
+			failures += !ok;
+			cerr << c.name << ": theta error " << theta_error << ", gradient error " << grad_error
+				<< (ok ? "" : "  FAILED") << endl;
+		}
+
+		if (failures > 0) {
+			cerr << failures << " case(s) above the tolerance " << tolerance << endl;
+			return 1;
+		}
+		cerr << "all cases within " << tolerance << endl;
+		return 0;
+	}
+}
@@ -0,0 +1,246 @@
+// Checks the EdgeBVH queries distance, winding_number and raycast against brute force over all edges,
+// on random star-shaped and non-convex (L, comb, spiral) polygons, with query points spread around the
+// polygon and exactly on its vertices and edges.
+// usage: check_edge_bvh [tolerance]
+// tolerance bounds the absolute error of distance and raycast (default 1e-12, the polygons are about 1 across).
+// winding_number has to match exactly: off the boundary the angle sum, on it the same half-open crossing
+// rule over all edges, so that the culling of the BVH never changes which edges count.
+// Prints every failed query, returns 1 if there was one.
+
+#include "common/common.h"
+
+#include "optimization/edge_bvh.h"
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	using optimization::EdgeBVH;
+
+	real cross(Vector2 a, Vector2 b) {
+		return a.x()*b.y() - a.y()*b.x();
+	}
+
+	real brute_distance(const vector<Vector2> &points, Vector2 p) {
+		real res = infinity;
+		for (int i = 0; i < (int)points.size(); i++) {
+			Vector2 a = points[i], ab = points[(i+1)%points.size()] - a;
+			real t = ab.squaredNorm() > 0. ? std::clamp((p - a).dot(ab) / ab.squaredNorm(), 0., 1.) : 0.;
+			res = min(res, (a + t*ab - p).norm());
+		}
+		return res;
+	}
+
+	// sum of the angles the edges span as seen from p, only defined off the boundary
+	int angle_winding_number(const vector<Vector2> &points, Vector2 p) {
+		real sum = 0.;
+		for (int i = 0; i < (int)points.size(); i++) {
+			Vector2 a = points[i] - p, b = points[(i+1)%points.size()] - p;
+			sum += std::atan2(cross(a, b), a.dot(b));
+		}
+		return (int)std::lround(sum / (2*M_PI));
+	}
+
+	// crossings of the ray in +x direction, upward edges include their start and downward ones their end
+	int crossing_winding_number(const vector<Vector2> &points, Vector2 p) {
+		int res = 0;
+		for (int i = 0; i < (int)points.size(); i++) {
+			Vector2 a = points[i], b = points[(i+1)%points.size()];
+			real side = cross(b - a, p - a);
+			if (a.y() <= p.y()) {
+				if (b.y() > p.y() && side > 0.) {
+					res++;
+				}
+			} else if (b.y() <= p.y() && side < 0.) {
+				res--;
+			}
+		}
+		return res;
+	}
+
+	real brute_raycast(const vector<Vector2> &points, Vector2 ro, Vector2 rd) {
+		Vector2 d = rd.normalized();
+		real res = infinity;
+		for (int i = 0; i < (int)points.size(); i++) {
+			Vector2 a = points[i], b = points[(i+1)%points.size()];
+			Vector2 ab = b - a, ao = a - ro;
+			real denom = cross(d, ab);
+			// same tolerance for parallel edges as EdgeBVH::raycast
+			real eps = 4. * std::numeric_limits<real>::epsilon();
+			if (std::abs(denom) > eps * ab.norm()) {
+				real t = cross(ao, ab) / denom;
+				real s = cross(ao, d) / denom;
+				if (t >= 0. && s >= 0. && s <= 1.) {
+					res = min(res, t);
+				}
+			} else if (std::abs(cross(ao, d)) <= eps * (ao.norm() + ab.norm())) {
+				real ta = ao.dot(d), tb = (b - ro).dot(d);
+				if (max(ta, tb) >= 0.) {
+					res = min(res, max(0., min(ta, tb)));
+				}
+			}
+		}
+		return res;
+	}
+
+	// counterclockwise, the radius of every vertex is random in [0.2, 1]
+	vector<Vector2> random_star(int n, std::mt19937 &rng) {
+		VectorX r = random_vector(n, rng);
+		vector<Vector2> res;
+		for (int i = 0; i < n; i++) {
+			real phi = 2*M_PI*i / n;
+			res.push_back((0.2 + 0.8*r(i)) * Vector2(cos(phi), sin(phi)));
+		}
+		return res;
+	}
+
+	vector<Vector2> l_shape() {
+		return {Vector2(0., 0.), Vector2(1., 0.), Vector2(1., 0.5), Vector2(0.5, 0.5), Vector2(0.5, 1.), Vector2(0., 1.)};
+	}
+
+	// teeth pointing up from a bar, all edges axis aligned, so many vertices share an x or y
+	vector<Vector2> comb(int teeth) {
+		vector<Vector2> res = {Vector2(0., 0.), Vector2(1., 0.)};
+		real w = 1. / (2*teeth - 1);
+		for (int i = teeth - 1; i >= 0; i--) {
+			res.push_back(Vector2(2*i*w + w, 1.));
+			res.push_back(Vector2(2*i*w, 1.));
+			if (i > 0) {
+				res.push_back(Vector2(2*i*w, 0.25));
+				res.push_back(Vector2(2*i*w - w, 0.25));
+			}
+		}
+		return res;
+	}
+
+	// thick spiral arm of the given number of turns, deeply non-convex
+	vector<Vector2> spiral(int n, real turns) {
+		vector<Vector2> outer, inner;
+		for (int i = 0; i <= n; i++) {
+			real t = real(i) / n;
+			real phi = 2*M_PI*turns*t;
+			Vector2 dir(cos(phi), sin(phi));
+			outer.push_back((0.1 + 0.9*t) * dir);
+			inner.push_back((0.05 + 0.9*t) * dir);
+		}
+		vector<Vector2> res = outer;
+		res.insert(res.end(), inner.rbegin(), inner.rend());
+		return res;
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		real tolerance = argc > 1 ? std::stod(argv[1]) : 1e-12;
+		std::mt19937 rng(1234);
+
+		struct Case {
+			string name;
+			vector<Vector2> points;
+		};
+		vector<Case> cases = {
+			{"L", l_shape()},
+			{"comb 3", comb(3)},
+			{"comb 40", comb(40)},
+			{"spiral", spiral(300, 2.5)},
+			{"triangle", {Vector2(0., 0.), Vector2(1., 0.), Vector2(0., 1.)}},
+		};
+		for (int n : {5, 17, 100, 1000}) {
+			cases.push_back({"random star " + to_string(n), random_star(n, rng)});
+		}
+		// the same polygons clockwise, the winding number changes sign
+		int count = cases.size();
+		for (int i = 0; i < count; i++) {
+			vector<Vector2> reversed(cases[i].points.rbegin(), cases[i].points.rend());
+			cases.push_back({cases[i].name + " reversed", reversed});
+		}
+
+		int failures = 0, queries = 0;
+		auto fail = [&](const string &name, const string &what, Vector2 p) {
+			failures++;
+			if (failures <= 50) {
+				cerr << "FAILED: " << name << ": " << what << " at (" << p.x() << ", " << p.y() << ")" << endl;
+			}
+		};
+
+		for (auto &c : cases) {
+			const vector<Vector2> &points = c.points;
+			EdgeBVH bvh(points);
+
+			// spread around the polygon, on its vertices and on its edges
+			vector<Vector2> on_boundary, spread;
+			for (int i = 0; i < (int)points.size(); i++) {
+				Vector2 a = points[i], b = points[(i+1)%points.size()];
+				on_boundary.push_back(a);
+				on_boundary.push_back(0.5*(a + b));
+				on_boundary.push_back(a + random_vector(1, rng)(0) * (b - a));
+			}
+			for (int i = 0; i < 500; i++) {
+				spread.push_back(3. * random_vector(2, rng).array() - 1.5);
+			}
+
+			for (bool boundary : {false, true}) {
+				for (Vector2 p : boundary ? on_boundary : spread) {
+					queries++;
+					real distance = bvh.distance(p);
+					real expected_distance = brute_distance(points, p);
+					if (!(std::abs(distance - expected_distance) <= tolerance)) {
+						fail(c.name, "distance " + to_string(distance) + ", brute force " + to_string(expected_distance), p);
+					}
+
+					int winding = bvh.winding_number(p);
+					int expected_winding = crossing_winding_number(points, p);
+					if (winding != expected_winding) {
+						fail(c.name, "winding number " + to_string(winding) + ", brute force " + to_string(expected_winding), p);
+					}
+					if (expected_distance > 1e-9 && winding != angle_winding_number(points, p)) {
+						fail(c.name, "winding number " + to_string(winding) + ", angle sum " + to_string(angle_winding_number(points, p)), p);
+					}
+
+					// random directions, along the axes and at the vertices
+					vector<Vector2> directions = {Vector2(1., 0.), Vector2(0., 1.), Vector2(-1., 0.), Vector2(0., -1.)};
+					real phi = 2*M_PI*random_vector(1, rng)(0);
+					directions.push_back(Vector2(cos(phi), sin(phi)));
+					directions.push_back(points[rng() % points.size()] - p);
+					for (Vector2 rd : directions) {
+						if (rd.squaredNorm() == 0.) {
+							continue;
+						}
+						real t = bvh.raycast(p, rd);
+						real expected_t = brute_raycast(points, p, rd);
+						bool ok = std::isinf(expected_t) ? std::isinf(t) : std::abs(t - expected_t) <= tolerance;
+						if (!ok) {
+							fail(c.name, "raycast along (" + to_string(rd.x()) + ", " + to_string(rd.y()) + ") "
+								+ to_string(t) + ", brute force " + to_string(expected_t), p);
+						}
+						// the hit is on the boundary
+						if (std::isfinite(t) && !(brute_distance(points, p + t*rd.normalized()) <= 1e-9)) {
+							fail(c.name, "raycast hit " + to_string(t) + " is not on the boundary", p);
+						}
+					}
+				}
+			}
+		}
+
+		if (failures > 0) {
+			cerr << failures << " of " << queries << " queries failed" << endl;
+			return 1;
+		}
+		cerr << "all " << queries << " queries on " << cases.size() << " polygons match brute force" << endl;
+		return 0;
+	}
+}
@@ -0,0 +1,215 @@
+// Checks the double precision overlap_area of two polygons against the exact CGAL booleans,
+// on squares that overlap, are identical, touch, are nested or have reversed orientation,
+// on non-convex L, U and star shapes, also against each other and with reflex vertices on the
+// other boundary, and on random rotated rectangles and stars.
+// usage: check_overlap_area [tolerance]
+// tolerance bounds the absolute area error (default 1e-9, the squares have area 1). Prints every
+// failed case, returns 1 if there was one.
+
+#include "common/common.h"
+#include "common/cgal_util.h"
+
+#include "optimization/edge_bvh.h"
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	using optimization::EdgeBVH;
+
+	// counterclockwise, reversed gives the clockwise one
+	vector<Vector2> rectangle(Vector2 min, Vector2 max, bool reversed = false) {
+		vector<Vector2> res = {min, Vector2(max.x(), min.y()), max, Vector2(min.x(), max.y())};
+		if (reversed) {
+			std::reverse(res.begin(), res.end());
+		}
+		return res;
+	}
+
+	vector<Vector2> square(real x, real y, real size = 1., bool reversed = false) {
+		return rectangle(Vector2(x, y), Vector2(x + size, y + size), reversed);
+	}
+
+	// L-shaped hexagon in the square (x, y)-(x+2*size, y+2*size), the upper right quarter is cut away,
+	// the reflex vertex is at (x+size, y+size)
+	vector<Vector2> l_shape(real x, real y, real size = 1., bool reversed = false) {
+		vector<Vector2> res = {
+			Vector2(x, y), Vector2(x + 2*size, y), Vector2(x + 2*size, y + size),
+			Vector2(x + size, y + size), Vector2(x + size, y + 2*size), Vector2(x, y + 2*size),
+		};
+		if (reversed) {
+			std::reverse(res.begin(), res.end());
+		}
+		return res;
+	}
+
+	// U shape in the square (x, y)-(x+3*size, y+3*size), open to the top with a notch of width size
+	// and depth 2*size, the reflex vertices are at (x+size, y+size) and (x+2*size, y+size)
+	vector<Vector2> u_shape(real x, real y, real size = 1., bool reversed = false) {
+		vector<Vector2> res = {
+			Vector2(x, y), Vector2(x + 3*size, y), Vector2(x + 3*size, y + 3*size),
+			Vector2(x + 2*size, y + 3*size), Vector2(x + 2*size, y + size), Vector2(x + size, y + size),
+			Vector2(x + size, y + 3*size), Vector2(x, y + 3*size),
+		};
+		if (reversed) {
+			std::reverse(res.begin(), res.end());
+		}
+		return res;
+	}
+
+	// star with the given number of tips around center, the reflex vertices are on the inner radius
+	vector<Vector2> star(Vector2 center, int tips, real outer, real inner, real rotation = 0., bool reversed = false) {
+		vector<Vector2> res;
+		for (int i = 0; i < 2*tips; i++) {
+			real phi = rotation + M_PI * i / tips;
+			real r = i % 2 ? inner : outer;
+			res.push_back(center + r * Vector2(std::cos(phi), std::sin(phi)));
+		}
+		if (reversed) {
+			std::reverse(res.begin(), res.end());
+		}
+		return res;
+	}
+
+	// the booleans need counterclockwise polygons, overlap_area doesn't care
+	real exact_overlap_area(const vector<Vector2> &a, const vector<Vector2> &b) {
+		auto to_polygon = [](const vector<Vector2> &points) {
+			Polygon res;
+			for (auto &p : points) {
+				res.push_back(Point(p.x(), p.y()));
+			}
+			if (res.is_clockwise_oriented()) {
+				res.reverse_orientation();
+			}
+			return res;
+		};
+		vector<PolygonWithHoles> intersection;
+		CGAL::intersection(to_polygon(a), to_polygon(b), std::back_inserter(intersection));
+		real res = 0.;
+		for (auto &polygon : intersection) {
+			res += CGAL::to_real(polygon.outer_boundary().area());
+			// holes are clockwise, their area is negative
+			for (auto hole = polygon.holes_begin(); hole != polygon.holes_end(); ++hole) {
+				res += CGAL::to_real(hole->area());
+			}
+		}
+		return res;
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		real tolerance = argc > 1 ? std::stod(argv[1]) : 1e-9;
+
+		struct Case {
+			string name;
+			vector<Vector2> a, b;
+		};
+		vector<Case> cases = {
+			{"overlapping",            square(0., 0.), square(0.5, 0.25)},
+			{"overlapping corner",     square(0., 0.), square(-0.5, -0.5)},
+			{"overlapping strip",      square(0., 0.), rectangle(Vector2(-1., 0.25), Vector2(2., 0.75))},
+			{"identical",              square(0., 0.), square(0., 0.)},
+			{"touching edge",          square(0., 0.), square(1., 0.)},
+			{"touching part of edge",  square(0., 0.), square(1., 0.5)},
+			{"touching corner",        square(0., 0.), square(1., 1.)},
+			{"disjoint",               square(0., 0.), square(2., 0.)},
+			{"nested",                 square(0., 0.), square(0.25, 0.25, 0.5)},
+			{"nesting",                square(0.25, 0.25, 0.5), square(0., 0.)},
+			{"nested on an edge",      square(0., 0.), rectangle(Vector2(0., 0.), Vector2(0.5, 1.))},
+			{"reversed",               square(0., 0.), square(0.5, 0.25, 1., true)},
+			{"both reversed",          square(0., 0., 1., true), square(0.5, 0.25, 1., true)},
+			{"identical reversed",     square(0., 0.), square(0., 0., 1., true)},
+			{"nested reversed",        square(0., 0.), square(0.25, 0.25, 0.5, true)},
+			{"touching edge reversed", square(0., 0.), square(1., 0., 1., true)},
+
+			// non-convex outline, convex target
+			{"L over square",                 l_shape(0., 0.), square(0.5, 0.5)},
+			{"L reflex vertex on corner",     l_shape(0., 0.), square(0.5, 0.5, 0.5)},
+			{"L reflex vertex in square",     l_shape(0., 0.), square(0.75, 0.75, 0.5)},
+			{"L reflex vertex on edge",       l_shape(0., 0.), square(0.5, 1.)},
+			{"L cut-out square",              l_shape(0., 0.), square(1., 1.)},
+			{"L reversed",                    l_shape(0., 0., 1., true), square(0.5, 0.5)},
+			{"U strip across notch",          u_shape(0., 0.), rectangle(Vector2(-1., 1.5), Vector2(4., 2.5))},
+			{"U strip along notch bottom",    u_shape(0., 0.), rectangle(Vector2(-1., 1.), Vector2(4., 2.))},
+			{"U square in notch",             u_shape(0., 0.), square(1., 1.)},
+			{"U square on both reflex",       u_shape(0., 0.), rectangle(Vector2(0.5, 0.5), Vector2(2.5, 1.5))},
+			{"star over square",              star(Vector2(0., 0.), 5, 1.5, 0.5), square(-0.3, -1.7, 2.)},
+			{"star reflex vertex on edge",    star(Vector2(0., 0.), 4, 2., 1., -M_PI/4.), rectangle(Vector2(1., -3.), Vector2(3., 3.))},
+			{"star in square",                star(Vector2(0.5, 0.5), 5, 0.4, 0.2), square(0., 0.)},
+			// convex outline, non-convex target
+			{"square over L",                 square(0.5, 0.5), l_shape(0., 0.)},
+			{"square over star",              square(-0.3, -1.7, 2.), star(Vector2(0., 0.), 5, 1.5, 0.5)},
+			// non-convex outline, non-convex target
+			{"L over L",                      l_shape(0., 0.), l_shape(0.5, 0.5)},
+			{"L reflex on L reflex",          l_shape(0., 0.), l_shape(2., 2., -1.)},
+			{"L reflex on L reflex reversed", l_shape(0., 0.), l_shape(2., 2., -1., true)},
+			{"L in U notch",                  u_shape(0., 0.), l_shape(1., 1., 0.5)},
+			{"U over U shifted",              u_shape(0., 0.), u_shape(1., 0.5)},
+			{"U interlocking U",              u_shape(0., 0.), u_shape(4., 4., -1.)},
+			{"U interlocking U shifted",      u_shape(0., 0.), u_shape(3.75, 3.5, -1.)},
+			{"star over star",                star(Vector2(0., 0.), 5, 1.5, 0.5), star(Vector2(0.3, 0.2), 5, 1.5, 0.5, 0.3)},
+			{"star identical",                star(Vector2(0., 0.), 5, 1.5, 0.5), star(Vector2(0., 0.), 5, 1.5, 0.5)},
+			{"star rotated by half a tip",    star(Vector2(0., 0.), 5, 1.5, 0.5), star(Vector2(0., 0.), 5, 1.5, 0.5, M_PI/5.)},
+			{"star over U",                   u_shape(0., 0.), star(Vector2(1.5, 2.), 6, 1.5, 0.4)},
+			{"star reversed over L",          l_shape(0., 0.), star(Vector2(1., 1.), 5, 1.2, 0.5, 0., true)},
+		};
+
+		std::mt19937 rng(1234);
+		for (int i = 0; i < 100; i++) {
+			VectorX r = random_vector(5, rng);
+			vector<Vector2> b = rectangle(Vector2(-0.5, -0.5), Vector2(0.5 + r(0), 0.5 + r(1)), i % 2);
+			Eigen::Rotation2D<real> rotation(2*M_PI*r(2));
+			for (auto &p : b) {
+				p = rotation * p + Vector2(r(3), r(4));
+			}
+			cases.push_back({"random rectangle " + to_string(i), square(0., 0.), b});
+		}
+		for (int i = 0; i < 100; i++) {
+			VectorX r = random_vector(5, rng);
+			int tips = 3 + i % 5;
+			vector<Vector2> b = star(Vector2(2.*r(0), 2.*r(1)), tips, 0.5 + r(2), 0.2 + 0.3*r(3), 2*M_PI*r(4), i % 2);
+			cases.push_back({"random star over L " + to_string(i), l_shape(0., 0.), b});
+		}
+
+		int failures = 0;
+		real max_error = 0.;
+		for (auto &c : cases) {
+			real exact = exact_overlap_area(c.a, c.b);
+			real fast = overlap_area(EdgeBVH(c.a), EdgeBVH(c.b));
+			vector<Vector2> grad;
+			real with_grad = overlap_area(EdgeBVH(c.a), c.b, grad);
+
+			real error = max(std::abs(fast - exact), std::abs(with_grad - exact));
+			// NaN compares false, so it counts as a failure
+			bool ok = error <= tolerance;
+			max_error = std::isnan(error) ? infinity : max(max_error, error);
+			if (!ok) {
+				failures++;
+				cerr << "FAILED: " << c.name << ": exact " << exact << ", overlap_area " << fast
+					<< ", with gradient " << with_grad << endl;
+			}
+		}
+
+		if (failures > 0) {
+			cerr << failures << " of " << cases.size() << " case(s) above the tolerance " << tolerance << endl;
+			return 1;
+		}
+		cerr << "all " << cases.size() << " cases within " << tolerance << ", largest error " << max_error << endl;
+		return 0;
+	}
+}
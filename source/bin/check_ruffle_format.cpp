@@ -0,0 +1,145 @@
+// Checks of the binary ruffle format: round trips, also through a file, and malformed data, which has to throw.
+// usage: check_ruffle_format
+// Prints every failed check, returns 1 if there was one.
+
+#include "common/common.h"
+
+#include "ruffle/ruffle.h"
+#include "ruffle/ruffle_format.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+namespace ruffles {
+	int inner_main(int argc, char* argv[]);
+}
+int main(int argc, char* argv[]) {
+	try {
+		return ruffles::inner_main(argc, argv);
+	}
+	catch (char const* x) {
+		std::cerr << "Error: " << std::string(x) << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+	}
+	return 1;
+}
+
+
+namespace ruffles {
+
+	int failures = 0;
+
+	void check(bool ok, const string &what) {
+		if (!ok) {
+			cerr << "FAILED: " << what << endl;
+			failures++;
+		}
+	}
+
+	// read has to throw and leave the ruffle as it was
+	void check_rejected(const vector<char> &data, const string &what) {
+		Ruffle ruffle = Ruffle::create_ruffle_stack(1, 3., 5.28, 0.5);
+		size_t sections = ruffle.sections.size();
+		try {
+			format::read(data.data(), data.size(), ruffle);
+			check(false, what + " was accepted");
+		} catch (const std::runtime_error &) {
+			check(ruffle.sections.size() == sections, what + " changed the ruffle");
+		}
+	}
+
+	format::Header &header_of(vector<char> &data) {
+		return *reinterpret_cast<format::Header *>(data.data());
+	}
+
+	int inner_main(int argc, char* argv[])
+	{
+		Ruffle ruffle = Ruffle::create_ruffle_stack(3, 3., 5.28, 0.5);
+		ruffle.densify3(std::next(ruffle.sections.begin(), 4));
+		ruffle.simulation_mesh.extra_mass.emplace_back(ruffle.simulation_mesh.vertices.begin(), 2.5);
+
+		vector<char> data;
+		format::write(ruffle, data);
+
+		// round trip, also from unaligned data
+		Ruffle copy;
+		format::read(data.data(), data.size(), copy);
+		vector<char> again;
+		format::write(copy, again);
+		check(again == data, "round trip");
+
+		vector<char> shifted(data.size() + 1);
+		std::copy(data.begin(), data.end(), shifted.begin() + 1);
+		Ruffle unaligned;
+		format::read(shifted.data() + 1, data.size(), unaligned);
+		again.clear();
+		format::write(unaligned, again);
+		check(again == data, "round trip from unaligned data");
+
+		// round trip through a file, read memory mapped
+		string path = (std::filesystem::temp_directory_path() / "check_ruffle_format.ruffle").string();
+		format::write_file(path, ruffle);
+		Ruffle from_file;
+		format::read_file(path, from_file);
+		again.clear();
+		format::write(from_file, again);
+		check(again == data, "round trip through a file");
+		std::ofstream(path, std::ios::trunc).close();
+		try {
+			format::read_file(path, from_file);
+			check(false, "empty file was accepted");
+		} catch (const std::runtime_error &) {}
+		std::filesystem::remove(path);
+		try {
+			format::read_file(path, from_file);
+			check(false, "missing file was accepted");
+		} catch (const std::runtime_error &) {}
+
+		// malformed data
+		check_rejected({}, "empty data");
+		check_rejected(vector<char>(data.begin(), data.begin() + sizeof(format::Header) - 1), "truncated header");
+		check_rejected(vector<char>(data.begin(), data.begin() + data.size() / 2), "truncated data");
+
+		vector<char> header_only(data.begin(), data.begin() + sizeof(format::Header));
+		header_of(header_only).size = 0;
+		check_rejected(header_only, "header only with size 0");
+		header_of(header_only).size = sizeof(format::Header);
+		check_rejected(header_only, "header only without room for the block table");
+
+		vector<char> broken = data;
+		header_of(broken).size = sizeof(format::Header) - 1;
+		check_rejected(broken, "size smaller than the header");
+
+		broken = data;
+		header_of(broken).block_count = UINT32_MAX;
+		check_rejected(broken, "block table larger than the data");
+
+		broken = data;
+		header_of(broken).magic ^= 1;
+		check_rejected(broken, "wrong magic number");
+
+		broken = data;
+		std::reverse(broken.begin(), broken.begin() + sizeof(uint32_t));
+		check_rejected(broken, "byte swapped data");
+
+		broken = data;
+		header_of(broken).version = format::version + 1;
+		check_rejected(broken, "newer version");
+
+		broken = data;
+		auto *blocks = reinterpret_cast<format::BlockRef *>(broken.data() + sizeof(format::Header));
+		blocks[format::Vertices].count = UINT64_MAX / 2;
+		check_rejected(broken, "block past the end");
+
+		if (failures > 0) {
+			cerr << failures << " check(s) failed" << endl;
+			return 1;
+		}
+		cerr << "all checks passed" << endl;
+		return 0;
+	}
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ruffles {
+
+/// Doubly linked list with the interface of std::list that keeps its elements in slabs of
+/// contiguous slots and reuses erased slots. Iterators stay valid until their element is erased
+/// like for std::list, they are the slot index plus the storage, which moves along with the arena.
+/// A copy has the same slot layout, so handles are translated by their index, see sibling().
+template<typename T>
+class Arena {
+	static constexpr int slab_bits = 6;
+	static constexpr int slab_size = 1 << slab_bits;
+
+	struct Slot {
+		std::optional<T> value;
+		int prev = 0;
+		int next = 0;
+	};
+
+	// slot 0 is the sentinel of the circular list and stands for end()
+	struct Storage {
+		std::vector<std::unique_ptr<Slot[]>> slabs;
+		int used = 1;
+		int free = -1; // erased slots, linked through next
+		int size = 0;
+
+		Storage() {
+			slabs.emplace_back(new Slot[slab_size]);
+		}
+		Slot &slot(int i) {
+			return slabs[i >> slab_bits][i & (slab_size-1)];
+		}
+		int allocate() {
+			if (free >= 0) {
+				int i = free;
+				free = slot(i).next;
+				return i;
+			}
+			if (used == (int)slabs.size() * slab_size) {
+				slabs.emplace_back(new Slot[slab_size]);
+			}
+			return used++;
+		}
+	};
+
+	template<bool Const>
+	class Iterator {
+	public:
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = T;
+		using difference_type = std::ptrdiff_t;
+		using pointer = std::conditional_t<Const, const T*, T*>;
+		using reference = std::conditional_t<Const, const T&, T&>;
+
+		Iterator() = default;
+		template<bool C = Const, typename = std::enable_if_t<C>>
+		Iterator(const Iterator<false> &it) : storage(it.storage), i(it.i) {}
+
+		reference operator*() const {
+			return *storage->slot(i).value;
+		}
+		pointer operator->() const {
+			return &**this;
+		}
+		Iterator &operator++() {
+			i = storage->slot(i).next;
+			return *this;
+		}
+		Iterator operator++(int) {
+			Iterator res = *this;
+			++*this;
+			return res;
+		}
+		Iterator &operator--() {
+			i = storage->slot(i).prev;
+			return *this;
+		}
+		Iterator operator--(int) {
+			Iterator res = *this;
+			--*this;
+			return res;
+		}
+		friend bool operator==(const Iterator &a, const Iterator &b) {
+			return a.i == b.i && a.storage == b.storage;
+		}
+		friend bool operator!=(const Iterator &a, const Iterator &b) {
+			return !(a == b);
+		}
+
+		/// slot of the element, the same in copies of the arena
+		int index() const {
+			return i;
+		}
+		/// the element in the given slot of the same arena
+		Iterator sibling(int index) const {
+			return Iterator(storage, index);
+		}
+
+	private:
+		friend class Arena;
+		template<bool> friend class Iterator;
+
+		Storage *storage = nullptr;
+		int i = -1;
+
+		Iterator(Storage *storage, int i) : storage(storage), i(i) {}
+	};
+
+public:
+	using value_type = T;
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	Arena() : storage(new Storage()) {}
+	/// the copy refers to the same slots, handles stored in its elements still point into other
+	Arena(const Arena &other) : Arena(other.transformed([](const T &x) { return x; })) {}
+	/// handles into other now belong to this arena, other is left empty
+	Arena(Arena &&other) : Arena() {
+		std::swap(storage, other.storage);
+	}
+	Arena &operator=(Arena other) {
+		std::swap(storage, other.storage);
+		return *this;
+	}
+
+	iterator begin() {
+		return iterator(storage.get(), storage->slot(0).next);
+	}
+	iterator end() {
+		return iterator(storage.get(), 0);
+	}
+	const_iterator begin() const {
+		return const_iterator(storage.get(), storage->slot(0).next);
+	}
+	const_iterator end() const {
+		return const_iterator(storage.get(), 0);
+	}
+	const_iterator cbegin() const {
+		return begin();
+	}
+	const_iterator cend() const {
+		return end();
+	}
+
+	size_t size() const {
+		return storage->size;
+	}
+	bool empty() const {
+		return storage->size == 0;
+	}
+
+	T &front() {
+		return *begin();
+	}
+	T &back() {
+		return *std::prev(end());
+	}
+	const T &front() const {
+		return *begin();
+	}
+	const T &back() const {
+		return *std::prev(end());
+	}
+
+	/// allocate slots for n more elements up front
+	void reserve(size_t n) {
+		while ((size_t)storage->slabs.size() * slab_size < storage->used + n) {
+			storage->slabs.emplace_back(new Slot[slab_size]);
+		}
+	}
+
+	template<typename... Args>
+	iterator emplace(const_iterator position, Args&&... args) {
+		int i = storage->allocate();
+		Slot &slot = storage->slot(i);
+		slot.value.emplace(std::forward<Args>(args)...);
+		slot.next = position.i;
+		slot.prev = storage->slot(position.i).prev;
+		storage->slot(slot.prev).next = i;
+		storage->slot(slot.next).prev = i;
+		storage->size++;
+		return iterator(storage.get(), i);
+	}
+	iterator insert(const_iterator position, const T &value) {
+		return emplace(position, value);
+	}
+	iterator insert(const_iterator position, T &&value) {
+		return emplace(position, std::move(value));
+	}
+	template<typename... Args>
+	T &emplace_back(Args&&... args) {
+		return *emplace(end(), std::forward<Args>(args)...);
+	}
+	void push_back(const T &value) {
+		emplace(end(), value);
+	}
+	void push_back(T &&value) {
+		emplace(end(), std::move(value));
+	}
+
+	/// returns the element after position
+	iterator erase(const_iterator position) {
+		int i = position.i;
+		Slot &slot = storage->slot(i);
+		storage->slot(slot.prev).next = slot.next;
+		storage->slot(slot.next).prev = slot.prev;
+		iterator res(storage.get(), slot.next);
+		slot.value.reset();
+		slot.next = storage->free;
+		storage->free = i;
+		storage->size--;
+		return res;
+	}
+	void clear() {
+		for (auto it = begin(); it != end(); ) {
+			it = erase(it);
+		}
+	}
+
+	/// arena with the same slot layout and f(x) in place of every element x,
+	/// a flat pass over the slots without any lookups
+	template<typename F>
+	Arena transformed(F f) const {
+		Arena res;
+		Storage &dst = *res.storage;
+		dst.slabs.resize(storage->slabs.size());
+		for (size_t s = 1; s < dst.slabs.size(); s++) {
+			dst.slabs[s].reset(new Slot[slab_size]);
+		}
+		for (int i = 0; i < storage->used; i++) {
+			Slot &from = storage->slot(i);
+			Slot &to = dst.slot(i);
+			if (from.value) {
+				to.value.emplace(f(*from.value));
+			}
+			to.prev = from.prev;
+			to.next = from.next;
+		}
+		dst.used = storage->used;
+		dst.free = storage->free;
+		dst.size = storage->size;
+		return res;
+	}
+
+private:
+	std::unique_ptr<Storage> storage;
+};
+
+}
@@ -3,15 +3,34 @@
 #include "common/common.h"
 
 #include <CGAL/Exact_predicates_exact_constructions_kernel.h>
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Boolean_set_operations_2.h>
 
 namespace ruffles {
 
+// exact constructions, needed where new geometry is built, e.g. polygon booleans
 typedef CGAL::Exact_predicates_exact_constructions_kernel K;
 typedef CGAL::Point_2<K> Point;
 typedef CGAL::Polygon_2<K> Polygon;
 typedef CGAL::Polygon_with_holes_2<K> PolygonWithHoles;
 
+// exact predicates on plain doubles, enough for triangulations without intersecting constraints and for queries
+typedef CGAL::Exact_predicates_inexact_constructions_kernel IK;
+
+// kernel per subsystem, RUFFLES_EXACT_* switches one back to exact constructions
+#ifdef RUFFLES_EXACT_AIR_MESH
+typedef K AirMeshKernel;
+#else
+typedef IK AirMeshKernel;
+#endif
+
+// only TargetShape::intersect_horizontal still uses it, the other queries run on EdgeBVH in doubles
+#ifdef RUFFLES_EXACT_QUERIES
+typedef K QueryKernel;
+#else
+typedef IK QueryKernel;
+#endif
+
 }
 
 namespace CGAL {
@@ -23,3 +42,14 @@ namespace CGAL {
 	}
 }
 
+namespace ruffles {
+	/// copy of an exact polygon in another kernel, rounded to doubles
+	template<class Kernel>
+	CGAL::Polygon_2<Kernel> convert_polygon(const Polygon &polygon) {
+		CGAL::Polygon_2<Kernel> res;
+		for (auto it = polygon.vertices_begin(); it != polygon.vertices_end(); ++it) {
+			res.push_back(typename Kernel::Point_2(CGAL::to_real(it->x()), CGAL::to_real(it->y())));
+		}
+		return res;
+	}
+}
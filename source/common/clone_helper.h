@@ -2,7 +2,7 @@
 
 #include "common/common.h"
 
-#include <unordered_map>
+#include <functional>
 
 namespace ruffles {
 
@@ -12,18 +12,20 @@ struct listref_hash {
 		return std::hash<T*>()(&*i);
 	}
 };
+/// Translates handles into an arena to the same slots of its copy made by transform(),
+/// the copy keeps the slot layout so this needs no lookup.
 template<typename T>
 class Translate {
-	std::unordered_map<listref<T>,listref<T>,listref_hash<T>> table;
+	// any handle into the copy, its storage stays put when the copy is moved
+	listref<T> copy;
 public:
 	listref<T> operator()(listref<T> x) {
-		return table[x];
+		return copy.sibling(x.index());
 	}
 	template<class F>
-	void transform(listref<T> begin, listref<T> end, list<T> &destination, F f) {
-		for (listref<T> it = begin; it != end; ++it) {
-			table.emplace(it, destination.insert(destination.end(), f(*it)));
-		}
+	void transform(const Arena<T> &source, Arena<T> &destination, F f) {
+		destination = source.transformed(f);
+		copy = destination.end();
 	}
 };
 
@@ -20,6 +20,14 @@ void panic_impl(std::string fname, int line, std::string what) {
 VectorX random_vector(int m) {
 	return VectorX::Random(m).array()*0.5+0.5;
 }
+VectorX random_vector(int m, std::mt19937 &rng) {
+	std::uniform_real_distribution<real> uniform(0., 1.);
+	VectorX res(m);
+	for (int i = 0; i < m; i++) {
+		res(i) = uniform(rng);
+	}
+	return res;
+}
 
 
 real angle(Vector6 x, Vector6 *grad, Matrix6 *hessian) {
@@ -119,6 +127,43 @@ real angle(Vector6 x, Vector6 *grad, Matrix6 *hessian) {
 	return theta;
 }
 
+void angle(const MatrixX6 &x, VectorX &theta, MatrixX6 *grad) {
+	ArrayX dx1 = x.col(2*1+0).array() - x.col(2*0+0).array();
+	ArrayX dy1 = x.col(2*1+1).array() - x.col(2*0+1).array();
+	ArrayX dx2 = x.col(2*2+0).array() - x.col(2*1+0).array();
+	ArrayX dy2 = x.col(2*2+1).array() - x.col(2*1+1).array();
+	ArrayX dx3 = x.col(2*2+0).array() - x.col(2*0+0).array();
+	ArrayX dy3 = x.col(2*2+1).array() - x.col(2*0+1).array();
+
+	ArrayX l1_sq = dx1.square() + dy1.square();
+	ArrayX l2_sq = dx2.square() + dy2.square();
+	ArrayX l3_sq = dx3.square() + dy3.square();
+
+	ArrayX l1 = l1_sq.sqrt();
+	ArrayX l2 = l2_sq.sqrt();
 
+	ArrayX a = l1_sq + l2_sq - l3_sq;
+	ArrayX b = 2*l1*l2;
+	ArrayX c = (a/b).max(-1.).min(1.);
+	theta = c.acos().matrix();
+
+	if (grad) {
+		// same derivative as the scalar version, expanded per coordinate:
+		// dtheta = -1/s * (da/b - a*db/b^2)
+		ArrayX s = (1-c.square()).max(0.).sqrt().max(1e-6);
+		ArrayX p = -1/(b*s);
+		ArrayX q = a/(b*b*s);
+		ArrayX r12 = l1/l2;
+		ArrayX r21 = l2/l1;
+
+		grad->resize(x.rows(), 6);
+		grad->col(0) = (p*2*(dx3-dx1) - q*2*r21*dx1).matrix();
+		grad->col(1) = (p*2*(dy3-dy1) - q*2*r21*dy1).matrix();
+		grad->col(2) = (p*2*(dx1-dx2) + q*2*(r21*dx1 - r12*dx2)).matrix();
+		grad->col(3) = (p*2*(dy1-dy2) + q*2*(r21*dy1 - r12*dy2)).matrix();
+		grad->col(4) = (p*2*(dx2-dx3) + q*2*r12*dx2).matrix();
+		grad->col(5) = (p*2*(dy2-dy3) + q*2*r12*dy2).matrix();
+	}
+}
 
 }
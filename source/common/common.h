@@ -2,6 +2,7 @@
 
 #include <Eigen/Core>
 #include <Eigen/Sparse>
+#include <Eigen/Eigenvalues>
 #include <vector>
 #include <utility>
 #include <string>
@@ -12,6 +13,9 @@
 #include <list>
 #include <array>
 #include <iterator>
+#include <random>
+
+#include "common/arena.h"
 
 #ifndef dbg
 #define dbg(x) debug_impl(#x, x)
@@ -62,8 +66,9 @@ using std::endl;
 using std::vector;
 using std::array;
 using std::list;
+/// handle of an element of an Arena<T>
 template<typename T>
-using listref = typename list<T>::iterator;
+using listref = typename Arena<T>::iterator;
 
 
 using std::tuple;
@@ -91,11 +96,19 @@ using Matrix3 = Eigen::Matrix<real, 3, 3>;
 using Matrix4 = Eigen::Matrix<real, 4, 4>;
 using Matrix6 = Eigen::Matrix<real, 6, 6>;
 using MatrixX = Eigen::Matrix<real, -1, -1>;
+using MatrixX2 = Eigen::Matrix<real, -1, 2>;
+using MatrixX6 = Eigen::Matrix<real, -1, 6>;
+using ArrayX = Eigen::Array<real, -1, 1>;
 
 VectorX random_vector(int n);
+/// uniform in [0,1) from the given stream instead of rand()
+VectorX random_vector(int n, std::mt19937 &rng);
 
 
 real angle(Vector6 x, Vector6 *grad = nullptr, Matrix6 *hessian = nullptr);
+// batched version of angle(), one corner per row. The columns are contiguous (SoA),
+// so Eigen vectorizes it with whatever packet size the target supports
+void angle(const MatrixX6 &x, VectorX &theta, MatrixX6 *grad = nullptr);
 
 // can't define in cpp file because template function
 template<typename T>
@@ -107,6 +120,14 @@ void addHessianBlock(const T &mat, int row, int col, std::vector<Eigen::Triplet<
 	}
 }
 
+// clamp negative eigenvalues of a symmetric element hessian to zero
+template<int N>
+Matrix<real, N, N> project_positive_definite(const Matrix<real, N, N> &mat) {
+	Eigen::SelfAdjointEigenSolver<Matrix<real, N, N>> eig(mat);
+	Matrix<real, N, 1> lambda = eig.eigenvalues().cwiseMax(0.);
+	return eig.eigenvectors() * lambda.asDiagonal() * eig.eigenvectors().transpose();
+}
+
 template<typename T1, typename T2>
 std::ostream &operator<<(std::ostream &os, const std::pair<T1, T2> &x) {
 	return os << "(" << x.first << "," << x.second << ")";
@@ -126,6 +147,13 @@ std::ostream &operator<<(std::ostream &os, const std::list<T> &x) {
 	return os;
 }
 template<typename T>
+std::ostream &operator<<(std::ostream &os, const Arena<T> &x) {
+	os << "[";
+	std::copy(x.cbegin(), x.cend(), std::ostream_iterator<T>(os, ", "));
+	os << "]";
+	return os;
+}
+template<typename T>
 std::ostream &operator<<(std::ostream &os, const std::vector<T> &x) {
 	os << "[";
 	std::copy(x.cbegin(), x.cend(), std::ostream_iterator<T>(os, ", "));
@@ -135,7 +163,9 @@ std::ostream &operator<<(std::ostream &os, const std::vector<T> &x) {
 
 template<typename It>
 std::enable_if_t<std::is_same_v<It, typename std::list<typename std::iterator_traits<It>::value_type>::iterator> ||
-                 std::is_same_v<It, typename std::list<typename std::iterator_traits<It>::value_type>::const_iterator>,
+                 std::is_same_v<It, typename std::list<typename std::iterator_traits<It>::value_type>::const_iterator> ||
+                 std::is_same_v<It, typename Arena<typename std::iterator_traits<It>::value_type>::iterator> ||
+                 std::is_same_v<It, typename Arena<typename std::iterator_traits<It>::value_type>::const_iterator>,
 std::ostream &>
 operator<<(std::ostream &os, const It &x) {
 	return os << "&" << *x;
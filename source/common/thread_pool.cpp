@@ -0,0 +1,126 @@
+#include "common/thread_pool.h"
+
+#include <atomic>
+#include <climits>
+#include <exception>
+
+namespace ruffles {
+
+namespace {
+	thread_local bool running_task = false;
+}
+
+ThreadPool::ThreadPool(int num_threads) {
+	// the calling thread takes part in parallel_for, so one thread less is enough
+	for (int i = 0; i < std::max(num_threads, 2) - 1; i++) {
+		workers.emplace_back([this]() { run(); });
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	task_available.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			task_available.wait(lock, [&]() { return stop || !tasks.empty(); });
+			if (tasks.empty()) {
+				return;
+			}
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int)> &f) {
+	parallel_for(n, [&](int i, int) {
+		f(i);
+	});
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int, int)> &f) {
+	if (n <= 0) {
+		return;
+	}
+	if (running_task || n == 1) {
+		for (int i = 0; i < n; i++) {
+			f(i, 0);
+		}
+		return;
+	}
+
+	struct State {
+		std::atomic<int> next{0};
+		int pending;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable finished;
+	} state;
+
+	// every participant takes indices until none are left
+	auto work = [&](int slot) {
+		running_task = true;
+		for (int i = state.next++; i < n; i = state.next++) {
+			try {
+				f(i, slot);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(state.mutex);
+				if (!state.error) {
+					state.error = std::current_exception();
+				}
+			}
+		}
+		running_task = false;
+	};
+
+	int helpers = std::min(size(), n-1);
+	state.pending = helpers;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int i = 0; i < helpers; i++) {
+			tasks.emplace_back([&, i]() {
+				work(i+1);
+				std::lock_guard<std::mutex> lock(state.mutex);
+				if (--state.pending == 0) {
+					state.finished.notify_one();
+				}
+			});
+		}
+	}
+	task_available.notify_all();
+
+	work(0);
+
+	std::unique_lock<std::mutex> lock(state.mutex);
+	state.finished.wait(lock, [&]() { return state.pending == 0; });
+	if (state.error) {
+		std::rethrow_exception(state.error);
+	}
+}
+
+ThreadPool &ThreadPool::instance() {
+	static ThreadPool pool;
+	return pool;
+}
+
+bool ThreadPool::in_worker() {
+	return running_task;
+}
+
+int parallel_threshold(int min_parallel) {
+	return ThreadPool::in_worker() ? INT_MAX : min_parallel;
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common/common.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <deque>
+
+namespace ruffles {
+
+/// Fixed set of worker threads that are kept alive between calls,
+/// for coarse grained work like solving many ruffles at once.
+class ThreadPool {
+public:
+	explicit ThreadPool(int num_threads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	int size() const {
+		return workers.size();
+	}
+
+	/// Calls f(i) for i in [0, n) on the workers and the calling thread, returns when all are done.
+	/// The first exception thrown by f is rethrown here. Nested calls from a worker run serially.
+	void parallel_for(int n, const std::function<void(int)> &f);
+	/// Same, f(i, slot) also gets the slot in [0, slots()) of the participating thread.
+	/// Within one call no two f with the same slot run at the same time, e.g. to reuse scratch data.
+	void parallel_for(int n, const std::function<void(int, int)> &f);
+	int slots() const {
+		return size() + 1;
+	}
+
+	/// shared pool with one thread per core
+	static ThreadPool &instance();
+	/// whether the calling thread is currently running work of some pool
+	static bool in_worker();
+
+private:
+	vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable task_available;
+	bool stop = false;
+
+	void run();
+};
+
+/// min_parallel argument for igl::parallel_for: loops started from a ThreadPool task
+/// run serially, the pool already keeps every core busy
+int parallel_threshold(int min_parallel);
+
+}
@@ -1,6 +1,9 @@
 #include "editor/serializer.h"
 #include <igl/serialize.h>
 
+#include <fstream>
+#include <iterator>
+
 
 namespace ruffles::model {
 
@@ -26,6 +29,9 @@ void Serializer::serialize(const std::string& scene_file, DataModel& data_model)
 		igl::serialize(part.cutline(), "cutline_" + to_string(i), scene_file);
 
 		igl::serialize(part.ruffle(), "ruffle_" + to_string(i), scene_file);
+
+		int parent = part.parent() != NULL ? int(part.parent() - data_model.parts.data()) : -1;
+		igl::serialize(parent, "parent_" + to_string(i), scene_file);
 	}
 }
 
@@ -40,37 +46,56 @@ void Serializer::deserialize(const std::string& scene_file, DataModel& data_mode
 	//igl::deserialize(data_model.target().V(), "target_mesh_V", scene_file);
 	//igl::deserialize(data_model.target().F(), "target_mesh_F", scene_file);
 
+	// read the file once, deserializing by file name would read it again for every object
+	std::vector<char> buffer;
+	{
+		std::ifstream file(scene_file, std::ios::binary);
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
 	Mesh target_mesh;
-	igl::deserialize(target_mesh, "target_mesh", scene_file);
+	igl::deserialize(target_mesh, "target_mesh", buffer);
 	data_model.target(target_mesh);
 
 	int number_parts;
-	igl::deserialize(number_parts, "number_parts", scene_file);
+	igl::deserialize(number_parts, "number_parts", buffer);
 
+	// saved ruffles are restored as they are, only parts saved without one are solved again
+	vector<int> parents(number_parts, -1);
+	vector<int> unsolved;
+	data_model.parts.reserve(number_parts);
 	for (int i = 0; i < number_parts; i++)
 	{
 		Mesh sub_mesh;
-		igl::deserialize(sub_mesh, "sub_mesh_" + to_string(i), scene_file);
-		data_model.parts.emplace_back(sub_mesh);
-
-		ModelPart& part = data_model.parts[i];
+		igl::deserialize(sub_mesh, "sub_mesh_" + to_string(i), buffer);
 
 		Plane cutting_plane;
-		igl::deserialize(cutting_plane, "cuttting_plane_" + to_string(i), scene_file);
-		part._plane = cutting_plane;
+		igl::deserialize(cutting_plane, "cuttting_plane_" + to_string(i), buffer);
 
 		Plane ground_plane;
-		igl::deserialize(ground_plane, "ground_plane_" + to_string(i), scene_file);
-		part._ground_plane = ground_plane;
+		igl::deserialize(ground_plane, "ground_plane_" + to_string(i), buffer);
 
 		Eigen::MatrixXd cutline;
-		igl::deserialize(cutline, "cutline_" + to_string(i), scene_file);
-		part.cutline(cutline);
+		igl::deserialize(cutline, "cutline_" + to_string(i), buffer);
 
 		Ruffle ruffle;
-		igl::deserialize(ruffle, "ruffle_" + to_string(i), scene_file);
-		part.ruffle(std::move(ruffle));
+		igl::deserialize(ruffle, "ruffle_" + to_string(i), buffer);
+		if (ruffle.sections.empty())
+			unsolved.push_back(i);
+
+		data_model.parts.emplace_back(sub_mesh, cutting_plane, ground_plane, cutline, std::move(ruffle));
+
+		// missing in scenes saved without the part tree
+		igl::deserialize(parents[i], "parent_" + to_string(i), buffer);
 	}
+
+	for (int i = 0; i < number_parts; i++)
+	{
+		if (parents[i] >= 0 && parents[i] < number_parts)
+			data_model.parts[parents[i]].add_child(&data_model.parts[i]);
+	}
+
+	data_model.solve_parts(unsolved);
 }
 
 }
\ No newline at end of file
@@ -7,7 +7,14 @@
 
 #include "common/clone_helper.h"
 #include "common/imgui.h"
-#include "output/create_svg.h"
+#include "output/export_pattern.h"
+
+#include "simulation/verlet.h"
+#include "simulation/lbfgs.h"
+#include "simulation/line_search.h"
+#include "simulation/combination.h"
+#include "simulation/newton.h"
+#include "simulation/fire.h"
 
 
 namespace ruffles::editor {
@@ -56,13 +63,20 @@ void RuffleOptimizer::update_menu(Menu& menu)
 		has_changed = true;
 	}
 
-	if (ImGui::Button("Export SVGs")) {
-		int i = 0;
+	ImGui::InputText("Export directory", export_directory, IM_ARRAYSIZE(export_directory));
+	ImGui::CheckboxFlags("SVG", &export_formats, SVG);
+	ImGui::SameLine();
+	ImGui::CheckboxFlags("DXF", &export_formats, DXF);
+	ImGui::SameLine();
+	if (ImGui::Button("Export patterns")) {
+		vector<Ruffle*> ruffles;
 		for (auto &part : data_model.parts) {
-			auto svg = create_svg(part.ruffle());
-			auto fname = "/tmp/part" + to_string(i) + ".svg";
-			svg->SaveFile(fname.c_str());
-			i++;
+			ruffles.push_back(&part.ruffle());
+		}
+		try {
+			export_patterns(ruffles, export_directory, export_formats);
+		} catch (const std::exception &e) {
+			write_log(1) << "export failed: " << e.what() << std::endl;
 		}
 	}
 
@@ -78,6 +92,17 @@ void RuffleOptimizer::update_menu(Menu& menu)
 		has_changed = true;
 	}
 
+	if (ImGui::Button("Step adjoint")) {
+		optimization::Adjoint adjoint(part->target());
+		adjoint.max_relative_change = adjoint_step;
+		adjoint.step(part->ruffle());
+		adjoint_energy = adjoint.last_energy;
+		has_changed = true;
+	}
+	ImGui::SameLine();
+	ImGui::Text("E = %g", adjoint_energy);
+	ImGui::InputReal("adjoint step", &adjoint_step);
+
 	//if (ImGui::Button("Step heuristic (outer)")) {
 	//	optimization::Heuristic heuristic(part->target());
 	//	heuristic.step_outer(part->ruffle());
@@ -94,11 +119,20 @@ void RuffleOptimizer::update_menu(Menu& menu)
 		part->ruffle().physics_solve();
 		has_changed = true;
 	}
+	ImGui::SameLine();
+	if (ImGui::Button("Solve with parents")) {
+		data_model.solve_parts({ view_model.selected_part_index });
+		has_changed = true;
+	}
 
 	if (ImGui::Button("(Re-)Generate air mesh")) {
 		part->ruffle().simulation_mesh.generate_air_mesh();
 		has_changed = true;
 	}
+
+	if (ImGui::CollapsingHeader("Simulator")) {
+		simulator_menu();
+	}
 /*
 	if (ImGui::Button("perturb")) {
 		part->ruffle().simulation_mesh.perturb(0.1 * part->ruffle().h);
@@ -124,6 +158,7 @@ void RuffleOptimizer::update_menu(Menu& menu)
 		ImGui::InputDouble("k_M", &part->ruffle().simulation_mesh.lambda_membrane);
 		ImGui::InputDouble("k_B", &part->ruffle().simulation_mesh.k_bend);
 		ImGui::InputDouble("k_AM", &part->ruffle().simulation_mesh.lambda_air_mesh);
+		ImGui::Checkbox("Air mesh barrier", &part->ruffle().simulation_mesh.air_mesh_barrier);
 
 		ImGui::Separator();
 
@@ -156,6 +191,38 @@ void RuffleOptimizer::update_menu(Menu& menu)
 	ImGui::Unindent();
 }
 
+void RuffleOptimizer::simulator_menu()
+{
+	using namespace simulation;
+	auto &ruffle = part->ruffle();
+
+	const char *names[] = {"Verlet", "LBFGS", "Line search", "Combination", "Newton", "FIRE"};
+	Simulator *current = ruffle.simulator.get();
+	int selected =
+		dynamic_cast<Verlet*>(current)      ? 0 :
+		dynamic_cast<LBFGS*>(current)       ? 1 :
+		dynamic_cast<LineSearch*>(current)  ? 2 :
+		dynamic_cast<Combination*>(current) ? 3 :
+		dynamic_cast<Newton*>(current)      ? 4 :
+		dynamic_cast<FIRE*>(current)        ? 5 : -1;
+
+	if (ImGui::Combo("Simulator", &selected, names, IM_ARRAYSIZE(names))) {
+		const SimulationMesh &mesh = ruffle.simulation_mesh;
+		switch (selected) {
+			case 0: ruffle.simulator.reset(new Verlet(mesh)); break;
+			case 1: ruffle.simulator.reset(new LBFGS(mesh)); break;
+			case 2: ruffle.simulator.reset(new LineSearch(mesh)); break;
+			case 3: ruffle.simulator.reset(new Combination(mesh)); break;
+			case 4: ruffle.simulator.reset(new Newton(mesh)); break;
+			case 5: ruffle.simulator.reset(new FIRE(mesh)); break;
+		}
+	}
+
+	if (ruffle.simulator) {
+		ruffle.simulator->menu_callback();
+	}
+}
+
 bool RuffleOptimizer::callback_key_up(igl::opengl::glfw::Viewer& viewer, unsigned int key, int modifiers)
 {
 	if (part == NULL)
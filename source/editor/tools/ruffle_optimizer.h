@@ -5,6 +5,8 @@
 #include "model/plane.h"
 
 #include "optimization/heuristic.h"
+#include "optimization/adjoint.h"
+#include "output/export_pattern.h"
 
 using namespace ruffles::model;
 namespace ruffles::editor {
@@ -28,9 +30,17 @@ private:
 	ModelPart* part = NULL;
 	std::vector<int> view_indices;
 	int ruffle_mesh_view_index = -1;
+	/// Adjoint::max_relative_change and the energy after the last adjoint step
+	real adjoint_step = 0.1;
+	real adjoint_energy = infinity;
+	/// where and as what "Export patterns" writes the parts
+	char export_directory[256] = "/tmp";
+	unsigned int export_formats = SVG;
 
 
 	void update_part_view(igl::opengl::glfw::Viewer& viewer, int part_index);
+	/// choose the simulator of the selected part and show its settings
+	void simulator_menu();
 	bool have_parts_changed();
 };
 
@@ -1,6 +1,8 @@
 #include "editor/tools/segmenter.h"
 
 #include <stack>
+#include <queue>
+#include <limits>
 #include <algorithm>
 
 #include <igl/dijkstra.h>
@@ -42,7 +44,7 @@ std::vector<int> get_invalid_indices(const std::vector<int>& list, const int& in
 	return unlabled;
 }
 
-void dfs(const std::vector<std::vector<int>>& search_list, const int& start_index, std::vector<int>& obstacles, std::vector<int>& out_component)
+void dfs(const Mesh::Adjacency& search_list, const int& start_index, std::vector<int>& obstacles, std::vector<int>& out_component)
 {
 	// Initially mark all verices as not visited 
 	std::vector<bool> visited(search_list.size(), false);
@@ -90,6 +92,35 @@ void dfs(const std::vector<std::vector<int>>& search_list, const int& start_inde
 	}
 }
 
+// igl::dijkstra with unit edge lengths for adjacency lists in a Mesh::Adjacency, i.e. breadth first search
+int shortest_paths(int source, const std::set<int>& targets, const Mesh::Adjacency& adjacency, Eigen::VectorXd& min_distance, Eigen::VectorXi& previous)
+{
+	min_distance.setConstant(adjacency.size(), std::numeric_limits<double>::infinity());
+	previous.setConstant(adjacency.size(), -1);
+	min_distance[source] = 0;
+
+	std::queue<int> queue;
+	queue.push(source);
+	while (!queue.empty())
+	{
+		int u = queue.front();
+		queue.pop();
+		if (targets.count(u))
+			return u;
+
+		for (int v : adjacency[u])
+		{
+			if (min_distance[v] <= min_distance[u] + 1)
+				continue;
+			min_distance[v] = min_distance[u] + 1;
+			previous[v] = u;
+			queue.push(v);
+		}
+	}
+
+	return -1;
+}
+
 //TODO remove! only for temp debug
 bool debug_label_segments = false;
 bool debug_labels_visible = false;
@@ -319,7 +350,7 @@ Eigen::VectorXi Segmenter::label_faces()
 			int v = current_component[i];
 			vertex_lables[v] = current_label;
 
-			auto neighbor_faces = data_model.target().adjacency_VF().at(v);
+			auto neighbor_faces = data_model.target().adjacency_VF()[v];
 
 			for (int j = 0; j < neighbor_faces.size(); j++)
 			{
@@ -504,7 +535,7 @@ void Segmenter::find_edge_path()
 	std::set<int> targets{ pre_selected_vertex };
 	Eigen::VectorXd min_distance;
 	Eigen::VectorXi previous;
-	igl::dijkstra(source, targets, data_model.target().adjacency_VV(), min_distance, previous); //compute distances
+	shortest_paths(source, targets, data_model.target().adjacency_VV(), min_distance, previous); //compute distances
 	igl::dijkstra(pre_selected_vertex, previous, pre_segment_path); //backtrack to get shortest path
 
 	write_log(0) << "pre_segment_path: " << list_to_string(pre_segment_path) << std::endl;
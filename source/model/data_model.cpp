@@ -7,9 +7,13 @@
 
 #include "editor/utils/filesystem_io.h"
 #include "editor/utils/logger.h"
+#include "common/thread_pool.h"
 
-#include <map>
+#include <deque>
+#include <numeric>
+#include <optional>
 #include <set>
+#include <unordered_map>
 
 using namespace Eigen;
 namespace ruffles::model {
@@ -44,22 +48,24 @@ void DataModel::target(Eigen::MatrixXd& V, Eigen::MatrixXi& F)
 	target(mesh);
 }
 
-void DataModel::update_parts(Eigen::VectorXi C)
+void DataModel::update_parts(Eigen::VectorXi C, bool solve)
 {
 	const int n = C.maxCoeff() + 1;
 	write_log(4) << "data_model.update_parts with " << n << " component(s)" << std::endl;
 
-	//get faces from component labels
+	//get faces from component labels, one pass to count and one to copy
+	std::vector<int> label_length(n, 0);
+	for (int i = 0; i < C.rows(); i++)
+		label_length[C(i)]++;
+
 	std::vector<Eigen::MatrixXi> face_components(n);
 	for (int i = 0; i < n; i++)
 	{
-		int nf = (C.array() == i).count();
-		face_components[i].resize(nf, 3);
-
-		write_log(4) << "  label " << i << " count = " << nf << std::endl;
+		face_components[i].resize(label_length[i], 3);
+		write_log(4) << "  label " << i << " count = " << label_length[i] << std::endl;
 	}
 
-	std::vector<int> label_length(n, 0);
+	std::fill(label_length.begin(), label_length.end(), 0);
 	for (int i = 0; i < C.rows(); i++)
 	{
 		int label = C(i);
@@ -75,31 +81,52 @@ void DataModel::update_parts(Eigen::VectorXi C)
 	real min_y = infinity;
 	vector<std::set<int>> edges(n);
 
-	// yay c++
-	std::map<array<real,3>, int> dedup_vertices;
+	// component of the first face of every vertex
+	const Eigen::MatrixXi &F = _target.F();
+	vector<int> vertex_component(_target.V().rows(), -1);
+	for (int f = 0; f < F.rows(); f++) {
+		for (int j = 0; j < F.cols(); j++) {
+			if (vertex_component[F(f, j)] < 0) {
+				vertex_component[F(f, j)] = C(f);
+			}
+		}
+	}
+
+	// vertices at the same position, bitwise apart from -0 == 0
+	struct PositionHash {
+		size_t operator()(const array<real,3> &x) const {
+			size_t res = 0;
+			for (real c : x) {
+				res = res * 1000003 ^ std::hash<real>()(c);
+			}
+			return res;
+		}
+	};
+	std::unordered_map<array<real,3>, int, PositionHash> dedup_vertices;
+	dedup_vertices.reserve(_target.V().rows());
 
 	for (int i = 0; i < _target.V().rows(); i++) {
 		Vector3 xyz = _target.V().row(i);
 		array<real,3> xyz_array {xyz.x(), xyz.y(), xyz.z()};
 		min_y = min(min_y, xyz.y());
-		int c = C(_target.adjacency_VF()[i].front());
-		auto it = dedup_vertices.find(xyz_array);
-		if (it != dedup_vertices.end()) {
+		int c = vertex_component[i];
+		if (c < 0) continue; // unreferenced
+		auto [it, inserted] = dedup_vertices.emplace(xyz_array, c);
+		if (!inserted) {
 			edges[c].emplace(it->second);
 			edges[it->second].emplace(c);
-		} else {
-			dedup_vertices.emplace(xyz_array,c);
 		}
 	}
 
 	// parts on ground are "rooted" and form their own tree
-	vector<bool> rooted(n, false);
+	vector<char> rooted(n, false); // not vector<bool>, written concurrently
 
-	//add new parts based on components
-	Eigen::VectorXi I;
-	for (int i = 0; i < n; i++)
+	//add new parts based on components, every component on its own on the shared ThreadPool
+	vector<std::optional<ModelPart>> new_parts(n);
+	ThreadPool::instance().parallel_for(n, [&](int i)
 	{
 		Mesh mesh;
+		Eigen::VectorXi I;
 		igl::remove_unreferenced(_target.V(), face_components[i], mesh.V(), mesh.F(), I);
 
 		auto &V = mesh.V();
@@ -115,8 +142,8 @@ void DataModel::update_parts(Eigen::VectorXi C)
 		MatrixXi F_new;
 		igl::topological_hole_fill(F, dummy, bnd, F_new);
 		
-		int n = V.rows();
-		V.conservativeResize(n+bnd.size(), 3);
+		int nv = V.rows();
+		V.conservativeResize(nv+bnd.size(), 3);
 		
 		for (int i = 0; i < bnd.size(); i++) {
 			Vector3 mean = Vector3::Zero();
@@ -124,29 +151,28 @@ void DataModel::update_parts(Eigen::VectorXi C)
 				mean += V.row(x).transpose();
 			}
 			mean /= bnd[i].size();
-			V.row(n+i) = mean.transpose();
+			V.row(nv+i) = mean.transpose();
 		}
 
 		mesh.F(F_new);
 		// this should have called update, we don't need to feed V again (it was modified inplace)
 
-		parts.emplace_back(mesh);
-		auto &part = parts.back();
+		// solved below once the part tree is known
+		auto &part = new_parts[i].emplace(mesh, false);
 
 		if (!rooted[i]) {
 			// align "ground" plane through boundary loop
 			assert(!bnd.empty());
-			vector<int> &longest_boundary = bnd.front();;
-			int longest_boundary_length = 0;
-			for (auto &loop : bnd) {
-				if (loop.size() > longest_boundary_length) {
-					longest_boundary_length = loop.size();
-					longest_boundary = loop;
+			int longest_boundary = 0;
+			for (int j = 0; j < bnd.size(); j++) {
+				if (bnd[j].size() > bnd[longest_boundary].size()) {
+					longest_boundary = j;
 				}
 			}
+			int longest_boundary_length = bnd[longest_boundary].size();
 			MatrixX V_bnd(longest_boundary_length, 3);
 			for (int i = 0; i < longest_boundary_length; i++) {
-				V_bnd.row(i) = V.row(longest_boundary[i]);
+				V_bnd.row(i) = V.row(bnd[longest_boundary][i]);
 			}
 
 			part.ground_plane().align_pca(V_bnd);
@@ -157,6 +183,11 @@ void DataModel::update_parts(Eigen::VectorXi C)
 			}
 
 		}
+	});
+
+	parts.reserve(n);
+	for (auto &part : new_parts) {
+		parts.push_back(std::move(*part));
 	}
 
 
@@ -164,21 +195,21 @@ void DataModel::update_parts(Eigen::VectorXi C)
 
 
 
-	// dfs
+	// dfs, every part that is not rooted gets the part it was reached from as parent
 	vector<bool> vis(n, false);
 	vector<int> stack;
 	for (int i = 0; i < n; i++) {
 		if (rooted[i]) {
+			vis[i] = true;
 			stack.push_back(i);
 			while (!stack.empty()) {
 				int x = stack.back();
 				stack.pop_back();
-				if (vis[i]) continue;
-				vis[i] = true;
 				for (auto y : edges[x]) {
-					if (!rooted[y]) {
+					if (!rooted[y] && !vis[y]) {
 						dbg(x);
 						dbg(y);
+						vis[y] = true;
 						parts[x].add_child(&parts[y]);
 						stack.push_back(y);
 					}
@@ -187,15 +218,101 @@ void DataModel::update_parts(Eigen::VectorXi C)
 		}
 	}
 
-	for (auto &part : parts) {
-		part.update_extra_masses();
-	}
+	if (solve)
+		solve_parts();
 
 	if (parts.size() == 1) {
 		//parts[0].apex = Vector3(0., 10., 30);
 	}
 }
 
+void DataModel::solve_parts() {
+	vector<int> all(parts.size());
+	std::iota(all.begin(), all.end(), 0);
+	solve_parts(all);
+}
+
+void DataModel::solve_parts(const vector<int> &changed) {
+	for_parts_bottom_up(changed, [](ModelPart &part) {
+		part.solve();
+	});
+}
+
+void DataModel::for_parts_bottom_up(const vector<int> &changed, const std::function<void(ModelPart&)> &f) {
+	const int n = parts.size();
+	auto index = [&](ModelPart *part) {
+		return int(part - parts.data());
+	};
+
+	// a changed part changes the extra mass of all its ancestors
+	vector<bool> dirty(n, false);
+	for (int i : changed) {
+		for (ModelPart *part = &parts[i]; part != NULL && !dirty[index(part)]; part = part->parent()) {
+			dirty[index(part)] = true;
+		}
+	}
+
+	// a part is ready once all its dirty children are done
+	vector<int> pending(n, 0);
+	std::deque<int> ready;
+	int remaining = 0;
+	for (int i = 0; i < n; i++) {
+		if (!dirty[i]) continue;
+		remaining++;
+		for (auto c : parts[i].children()) {
+			pending[i] += dirty[index(c)];
+		}
+		if (pending[i] == 0) {
+			ready.push_back(i);
+		}
+	}
+	if (remaining == 0) {
+		return;
+	}
+
+	std::mutex mutex;
+	std::condition_variable changed_state;
+	std::exception_ptr error;
+
+	// every thread takes ready parts until all are done
+	auto work = [&](int) {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			changed_state.wait(lock, [&]() { return !ready.empty() || remaining == 0; });
+			if (ready.empty()) {
+				return;
+			}
+			int i = ready.front();
+			ready.pop_front();
+
+			lock.unlock();
+			try {
+				f(parts[i]);
+			} catch (...) {
+				std::lock_guard<std::mutex> error_lock(mutex);
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+			lock.lock();
+
+			remaining--;
+			ModelPart *parent = parts[i].parent();
+			if (parent != NULL && --pending[index(parent)] == 0) {
+				ready.push_back(index(parent));
+			}
+			changed_state.notify_all();
+		}
+	};
+
+	auto &pool = ThreadPool::instance();
+	pool.parallel_for(std::min(pool.slots(), remaining), work);
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
 void DataModel::update_parts_graph(int root_component) {
 	
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "model/model_part.h"
+
+#include <functional>
 //#include "editor/tools/segmenter.h"
 
 namespace ruffles::model {
@@ -25,7 +27,15 @@ public:
 	bool has_target_file();
 
 
-	void update_parts(Eigen::VectorXi face_component_labels);
+	/// solve = false leaves the new parts unsolved, e.g. to change their parameters first
+	void update_parts(Eigen::VectorXi face_component_labels, bool solve = true);
+	/// physics solve of every part, children before their parents so that extra masses are final,
+	/// parts that don't depend on each other run concurrently on the shared ThreadPool
+	void solve_parts();
+	/// same for the given parts and their ancestors only, e.g. after a part changed
+	void solve_parts(const vector<int> &changed);
+	/// f(part) for the given parts and their ancestors in the order of solve_parts
+	void for_parts_bottom_up(const vector<int> &changed, const std::function<void(ModelPart&)> &f);
 	void clear();
 
 	void update_parts_graph(int root);
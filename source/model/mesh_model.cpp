@@ -3,13 +3,34 @@
 #include <igl/per_vertex_normals.h>
 #include <igl/per_face_normals.h>
 
-#include <igl/adjacency_list.h>
-#include <igl/vertex_triangle_adjacency.h>
 #include <igl/triangle_triangle_adjacency.h>
 
+#include <algorithm>
+
 
 namespace ruffles::model {
 
+namespace {
+
+// counting sort of the (key, value) pairs produced by for_each_pair(emit) into adjacency lists
+template<typename F>
+void build_adjacency(int n, F for_each_pair, Mesh::Adjacency& adjacency)
+{
+	auto& offsets = adjacency.offsets;
+	auto& indices = adjacency.indices;
+
+	offsets.assign(n + 1, 0);
+	for_each_pair([&](int key, int value) { offsets[key + 1]++; });
+	for (int i = 0; i < n; i++)
+		offsets[i + 1] += offsets[i];
+
+	indices.resize(offsets[n]);
+	std::vector<int> next(offsets.begin(), offsets.end() - 1);
+	for_each_pair([&](int key, int value) { indices[next[key]++] = value; });
+}
+
+}
+
 Eigen::MatrixXd& Mesh::V()
 {
 	return _V;
@@ -18,7 +39,7 @@ Eigen::MatrixXd& Mesh::V()
 void Mesh::V(Eigen::MatrixXd& value)
 {
 	_V = value;
-	update();
+	invalidate_geometry();
 }
 
 Eigen::MatrixXi& Mesh::F()
@@ -28,7 +49,7 @@ Eigen::MatrixXi& Mesh::F()
 void Mesh::F(Eigen::MatrixXi& value)
 {
 	_F = value;
-	update();
+	invalidate_topology();
 }
 
 Eigen::MatrixXd& Mesh::NV()
@@ -47,20 +68,54 @@ Eigen::MatrixXd& Mesh::NF()
 	return _NF;
 }
 
-std::vector<std::vector<int>>& Mesh::adjacency_VV()
+const Mesh::Adjacency& Mesh::adjacency_VV()
 {
-	if (_adjacency_VV.size() < 1)
-		igl::adjacency_list(_F, _adjacency_VV);
+	if (_adjacency_VV.offsets.empty())
+	{
+		// both directions of every face edge, then without duplicates
+		auto edges = [&](auto emit) {
+			for (int f = 0; f < _F.rows(); f++)
+				for (int j = 0; j < _F.cols(); j++)
+				{
+					int a = _F(f, j);
+					int b = _F(f, (j + 1) % _F.cols());
+					emit(a, b);
+					emit(b, a);
+				}
+		};
+		build_adjacency(vertex_count(), edges, _adjacency_VV);
+
+		auto& offsets = _adjacency_VV.offsets;
+		auto& indices = _adjacency_VV.indices;
+		int size = 0;
+		for (int i = 0; i < _adjacency_VV.size(); i++)
+		{
+			auto first = indices.begin() + offsets[i];
+			auto last = indices.begin() + offsets[i + 1];
+			std::sort(first, last);
+			last = std::unique(first, last);
+
+			offsets[i] = size;
+			size = std::copy(first, last, indices.begin() + size) - indices.begin();
+		}
+		offsets.back() = size;
+		indices.resize(size);
+	}
 
 	return _adjacency_VV;
 }
 
-std::vector<std::vector<int>>& Mesh::adjacency_VF()
+const Mesh::Adjacency& Mesh::adjacency_VF()
 {
-	if (_adjacency_VF.size() < 1)
+	if (_adjacency_VF.offsets.empty())
 	{
-		std::vector<std::vector<int>> VFi_unused;
-		igl::vertex_triangle_adjacency(_V, _F, _adjacency_VF, VFi_unused);
+		// faces in increasing order for every vertex
+		auto corners = [&](auto emit) {
+			for (int f = 0; f < _F.rows(); f++)
+				for (int j = 0; j < _F.cols(); j++)
+					emit(_F(f, j), f);
+		};
+		build_adjacency(vertex_count(), corners, _adjacency_VF);
 	}
 
 	return _adjacency_VF;
@@ -91,21 +146,31 @@ void Mesh::clear()
 	_V.resize(0, Eigen::NoChange);
 	_F.resize(0, Eigen::NoChange);
 
-	update();
+	invalidate_topology();
 	_NV.resize(0, Eigen::NoChange);
 }
 
-void Mesh::update()
-{ 
+void Mesh::invalidate_geometry()
+{
 	if(!_keep_NV)
 		_NV.resize(0, Eigen::NoChange);
 	_NF.resize(0, Eigen::NoChange);
+}
 
-	_adjacency_VV.clear();
-	_adjacency_VF.clear();
+void Mesh::invalidate_topology()
+{
+	invalidate_geometry();
+
+	_adjacency_VV = Adjacency();
+	_adjacency_VF = Adjacency();
 	_adjacency_FF.resize(0, Eigen::NoChange);
 }
 
+int Mesh::vertex_count()
+{
+	return std::max<int>(_V.rows(), _F.size() > 0 ? _F.maxCoeff() + 1 : 0);
+}
+
 void Mesh::InitSerialization()
 {
 	this->Add(_V, "V");
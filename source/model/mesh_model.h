@@ -17,6 +17,30 @@ public:
 
 	virtual ~Mesh() {}
 
+	/// adjacency lists in two flat arrays, the neighbors of i are indices[offsets[i]] .. indices[offsets[i+1]-1]
+	struct Adjacency
+	{
+		std::vector<int> offsets;
+		std::vector<int> indices;
+
+		struct Range
+		{
+			const int* first;
+			const int* last;
+
+			const int* begin() const { return first; }
+			const int* end() const { return last; }
+			int size() const { return last - first; }
+			bool empty() const { return first == last; }
+			int front() const { return *first; }
+			int operator[](int i) const { return first[i]; }
+		};
+
+		int size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+		bool empty() const { return size() == 0; }
+		Range operator[](int i) const { return { indices.data() + offsets[i], indices.data() + offsets[i + 1] }; }
+	};
+
 
 	Eigen::MatrixXd& V();
 	void V(Eigen::MatrixXd& value);
@@ -24,13 +48,18 @@ public:
 	Eigen::MatrixXi& F();
 	void F(Eigen::MatrixXi& value);
 
+	// computed on first use, changing V keeps the adjacencies, changing F drops everything
 	Eigen::MatrixXd& NV();
 	Eigen::MatrixXd& NF();
 
-	std::vector<std::vector<int>>& adjacency_VV();
-	std::vector<std::vector<int>>& adjacency_VF();
+	const Adjacency& adjacency_VV();
+	const Adjacency& adjacency_VF();
 	Eigen::MatrixXi& adjacency_FF();
 
+	/// drop what depends on V or F, for changes made through the references above
+	void invalidate_geometry();
+	void invalidate_topology();
+
 	bool is_valid();
 	bool is_vertex_valid(int vertex_index);
 
@@ -45,12 +74,13 @@ private:
 	Eigen::MatrixXd _NV;
 	Eigen::MatrixXd _NF;
 
-	std::vector<std::vector<int>> _adjacency_VV;
-	std::vector<std::vector<int>> _adjacency_VF;
+	Adjacency _adjacency_VV;
+	Adjacency _adjacency_VF;
 	Eigen::MatrixXi _adjacency_FF;
 
-	bool _keep_NV;
-	void update();
+	bool _keep_NV = false;
+
+	int vertex_count();
 
 	// Inherited via Serializable
 	virtual void InitSerialization() override;
@@ -14,7 +14,7 @@ namespace ruffles::model {
     using simulation::LBFGS;
     using simulation::Combination;
 
-    ModelPart::ModelPart(Mesh& segment) : _segment(segment)
+    ModelPart::ModelPart(Mesh& segment, bool solve) : _segment(segment)
     {
         _plane.align(_segment.V());
         _plane.translate_N=0.01;
@@ -32,7 +32,7 @@ namespace ruffles::model {
         _ground_plane.translate_N = t_min+0.01;
         _ground_plane.update_translation();
         auto x = _plane.cut(_segment);
-        cutline(x);
+        cutline(x, solve);
     }
 
 
@@ -53,7 +53,42 @@ namespace ruffles::model {
         return target_shape.V;
     }
 
-    void ModelPart::cutline(Eigen::MatrixXd& value)
+    ModelPart::ModelPart(Mesh& segment, Plane& plane, Plane& ground_plane, Eigen::MatrixXd& cutline, Ruffle&& ruffle)
+        : _segment(segment)
+    {
+        _plane = plane;
+        _ground_plane = ground_plane;
+        bool valid = update_target_shape(cutline);
+        if (valid) {
+            heuristic = optimization::Heuristic(target_shape);
+        }
+
+        if (!ruffle.sections.empty()) {
+            _ruffle = std::move(ruffle);
+            _ruffle.simulator.reset(new LBFGS(_ruffle.simulation_mesh));
+        } else if (valid) {
+            // nothing saved, start over without solving
+            reinit_ruffle();
+        }
+    }
+
+    void ModelPart::cutline(Eigen::MatrixXd& value, bool solve)
+    {
+        if (!update_target_shape(value))
+            return;
+
+        reinit_ruffle();
+
+ 
+        //_ruffle.simulator.reset(new Combination(_ruffle.simulation_mesh));
+        if (solve) {
+            _ruffle.physics_solve();
+        }
+
+        heuristic = optimization::Heuristic(target_shape);
+    }
+
+    bool ModelPart::update_target_shape(Eigen::MatrixXd& value)
     {
         assert(value.rows() > 0);
         Vector3 origin = value.row(0).transpose(); // temporary origin
@@ -115,20 +150,13 @@ namespace ruffles::model {
         if (std::isnan(width))
         {
             write_log(1) << "at ruffle creation: target_shape.avg_width() is " << width << linebreak;
-            return;
+            return false;
         }
 
         step_width = 0.666*width;
         stack_count = max(1, round(height / (0.5*step_width)));
         step_height = height/stack_count;
-        
-        reinit_ruffle();
-
- 
-        //_ruffle.simulator.reset(new Combination(_ruffle.simulation_mesh));
-        _ruffle.physics_solve();
-
-        heuristic = optimization::Heuristic(target_shape);
+        return true;
     }
 
     vector<real> ModelPart::intersect_at(Vector2 uv) {
@@ -175,6 +203,7 @@ namespace ruffles::model {
             }
         }
         mesh.interpolate_missing_z();
+        mesh.invalidate_compiled();
     }
 
     TargetShape& ModelPart::target()
@@ -202,13 +231,25 @@ namespace ruffles::model {
 
     void ModelPart::add_child(ModelPart *child) {
         _children.push_back(child);
+        child->_parent = this;
         update_extra_masses();
     }
     void ModelPart::clear_children() {
+        for (auto c : _children) {
+            c->_parent = NULL;
+        }
         _children.clear();
         update_extra_masses();
     }
 
+    ModelPart* ModelPart::parent() {
+        return _parent;
+    }
+
+    const vector<ModelPart*>& ModelPart::children() {
+        return _children;
+    }
+
     void ModelPart::update_extra_masses() {
         _ruffle.simulation_mesh.extra_mass.clear();
         for (auto c : _children) {
@@ -230,6 +271,12 @@ namespace ruffles::model {
 
             mesh.extra_mass.emplace_back(best, c->ruffle().simulation_mesh.total_mass());
         }
+        _ruffle.simulation_mesh.invalidate_compiled();
+    }
+
+    void ModelPart::solve() {
+        update_extra_masses();
+        _ruffle.physics_solve();
     }
 
     void ModelPart::update()
@@ -254,6 +301,8 @@ namespace ruffles::model {
         Vector3 gravity(0., -981., 0.); // TODO: set from where?
         _ruffle.simulation_mesh.gravity = Vector2(gravity.dot(target_shape.u_dir), gravity.dot(target_shape.v_dir));
         
+        // LBFGS limits its line search with the air mesh collision check, so the barrier can't be stepped over
+        _ruffle.simulation_mesh.air_mesh_barrier = true;
         _ruffle.simulator.reset(new LBFGS(_ruffle.simulation_mesh));
     }
 }
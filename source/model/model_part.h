@@ -16,7 +16,10 @@ namespace ruffles::model {
 	public:
 		friend class Serializer;
 
-		ModelPart(Mesh& segment);
+		/// solve = false leaves the ruffle unsolved, e.g. for DataModel::solve_parts
+		ModelPart(Mesh& segment, bool solve = true);
+		/// restore a saved part without cutting or solving, the ruffle is reinitialized if it is empty
+		ModelPart(Mesh& segment, Plane& plane, Plane& ground_plane, Eigen::MatrixXd& cutline, Ruffle&& ruffle);
 		// shut up c++
     	ModelPart(ModelPart&&) = default;
 		virtual ~ModelPart() { };
@@ -25,7 +28,7 @@ namespace ruffles::model {
 		void segment(Mesh& value); //recut outline with reference plane (if exists)
 
 		Eigen::MatrixXd& cutline();
-		void cutline(Eigen::MatrixXd& value); //re-init ruffle (?)
+		void cutline(Eigen::MatrixXd& value, bool solve = true); //re-init ruffle (?)
 
 		optimization::TargetShape &target(); //TODO rename, confusing with data_model.target()
 		Ruffle &ruffle();
@@ -38,8 +41,10 @@ namespace ruffles::model {
 		Plane& plane();
 		Plane& ground_plane();
 
-		real h = 0.5;
-		real u0_ratio = 1./6.;
+		static constexpr real default_h = 0.5;
+		static constexpr real default_u0_ratio = 1./6.;
+		real h = default_h;
+		real u0_ratio = default_u0_ratio;
 		int stack_count;
 		real step_width;
 		real step_height;
@@ -51,8 +56,13 @@ namespace ruffles::model {
 
 		void add_child(ModelPart *child);
 		void clear_children();
+		/// part this one rests on, NULL for parts on the ground
+		ModelPart* parent();
+		const vector<ModelPart*>& children();
 
 		void update_extra_masses();
+		/// update_extra_masses and physics solve, the children have to be solved already
+		void solve();
 
 
 		//TODO add groundplane for simulation
@@ -62,6 +72,7 @@ namespace ruffles::model {
 		Mesh _segment;
 
 		vector<ModelPart*> _children;
+		ModelPart* _parent = NULL;
 
 		//polyline from plane cut, store only longest polyline
 		optimization::TargetShape target_shape;
@@ -71,6 +82,8 @@ namespace ruffles::model {
 		Plane _ground_plane;
 
 		void update();
+		/// target shape and stack dimensions from the cutline, false if it is degenerate
+		bool update_target_shape(Eigen::MatrixXd& value);
 
 		vector<real> intersect_at(Vector2 uv);
 	};
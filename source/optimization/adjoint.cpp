@@ -0,0 +1,158 @@
+#include "optimization/adjoint.h"
+
+#include <Eigen/SparseCholesky>
+
+namespace ruffles::optimization {
+
+using SparseMatrix = Eigen::SparseMatrix<real>;
+
+Adjoint::Adjoint() {
+
+}
+Adjoint::Adjoint(TargetShape target)
+ : target(std::move(target)) {
+}
+
+vector<listref<Ruffle::Section>> Adjoint::sections(Ruffle &ruffle) {
+	vector<listref<Ruffle::Section>> res;
+	for (auto section = ruffle.sections.begin(); section != ruffle.sections.end(); ++section) {
+		if (section->type != Ruffle::Section::Type::Regular) {
+			res.push_back(section);
+		}
+	}
+	return res;
+}
+
+real Adjoint::gradient(Ruffle &ruffle, VectorX &grad) {
+	auto &mesh = ruffle.simulation_mesh;
+	const VectorX &x = mesh.x;
+	int n = x.size();
+	auto optimized = sections(ruffle);
+	grad = VectorX::Zero(optimized.size());
+
+	VectorX energy_grad;
+	real energy = target.energy(ruffle, &energy_grad);
+
+	// variables pressed against a bound stay there when the lengths change
+	VectorX force = VectorX::Zero(n);
+	mesh.energy(x, &force);
+	VectorXb active(n);
+	for (int i = 0; i < n; i++) {
+		active(i) = (x(i) <= mesh.lb(i%2) && force(i) > 0.) || (x(i) >= mesh.ub(i%2) && force(i) < 0.);
+		if (active(i)) {
+			energy_grad(i) = 0.;
+		}
+	}
+
+	// adjoint solve H mu = dE/dx, with the projected hessian if the exact one is not definite
+	VectorX mu;
+	for (bool project : {false, true}) {
+		if (project) {
+			cerr << "Adjoint: hessian is not definite, using the projected one, the gradient is approximate" << endl;
+		}
+		vector<Eigen::Triplet<real>> triplets, free_triplets;
+		mesh.hessian(x, triplets, project);
+		for (auto &t : triplets) {
+			if (!active(t.row()) && !active(t.col())) {
+				free_triplets.push_back(t);
+			}
+		}
+		for (int i = 0; i < n; i++) {
+			free_triplets.emplace_back(i, i, active(i) ? 1. : 0.);
+		}
+		SparseMatrix hessian(n, n);
+		hessian.setFromTriplets(free_triplets.begin(), free_triplets.end());
+
+		Eigen::SimplicialLDLT<SparseMatrix> solver(hessian);
+		if (solver.info() == Eigen::Success) {
+			mu = solver.solve(energy_grad);
+			if (mu.allFinite()) {
+				break;
+			}
+		}
+		mu.resize(0);
+	}
+	if (mu.size() == 0) {
+		cerr << "Adjoint: hessian solve failed" << endl;
+		return energy;
+	}
+
+	// the equilibrium force(x, L) = 0 gives dx/dL = -H^-1 dforce/dL, so dE/dL = -mu^T dforce/dL.
+	// A length enters through the rest lengths and masses of its segments, differentiate numerically.
+	auto set_length = [&](Ruffle::Section &section, real length) {
+		for (auto &segment : section.mesh_segments) {
+			segment->length = length / section.mesh_segments.size();
+		}
+		mesh.update_vertex_mass();
+	};
+	VectorX force_plus(n), force_minus(n);
+	for (size_t s = 0; s < optimized.size(); s++) {
+		Ruffle::Section &section = *optimized[s];
+		real length = section.length;
+		real h = fd_epsilon * max(length, min_length);
+
+		set_length(section, length + h);
+		force_plus.setZero();
+		mesh.energy(x, &force_plus);
+		set_length(section, length - h);
+		force_minus.setZero();
+		mesh.energy(x, &force_minus);
+		set_length(section, length);
+
+		grad(s) = -mu.dot(force_plus - force_minus) / (2.*h);
+	}
+
+	return energy;
+}
+
+bool Adjoint::step(Ruffle &ruffle) {
+	last_solves = 0;
+	if (ruffle.physics_solve_count == 0) {
+		ruffle.physics_solve();
+		last_solves++;
+	}
+
+	VectorX grad;
+	real energy = gradient(ruffle, grad);
+	last_energy = energy;
+
+	auto optimized = sections(ruffle);
+	VectorX lengths(optimized.size());
+	real scale = 0.;
+	for (size_t s = 0; s < optimized.size(); s++) {
+		lengths(s) = optimized[s]->length;
+		scale = max(scale, std::abs(grad(s)) / lengths(s));
+	}
+	if (scale == 0.) {
+		return false;
+	}
+
+	// the first trial changes the most sensitive length by max_relative_change
+	real t = max_relative_change / scale;
+	for (int attempt = 0; attempt <= max_backtracking; attempt++) {
+		for (size_t s = 0; s < optimized.size(); s++) {
+			optimized[s]->length = max(min_length, lengths(s) - t*grad(s));
+		}
+		ruffle.update_simulation_mesh();
+		ruffle.physics_solve(true);
+		last_solves++;
+
+		real new_energy = target.energy(ruffle);
+		if (new_energy < energy) {
+			last_energy = new_energy;
+			return true;
+		}
+		t *= 0.5;
+	}
+
+	// no decrease, back to the previous lengths
+	for (size_t s = 0; s < optimized.size(); s++) {
+		optimized[s]->length = lengths(s);
+	}
+	ruffle.update_simulation_mesh();
+	ruffle.physics_solve(true);
+	last_solves++;
+	return false;
+}
+
+}
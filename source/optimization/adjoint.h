@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common/common.h"
+#include "ruffle/ruffle.h"
+#include "optimization/target_shape.h"
+
+namespace ruffles::optimization {
+
+/// Gradient descent on TargetShape::energy over the section lengths. The derivative of the
+/// equilibrium with respect to the lengths follows from the implicit function theorem,
+/// so every step needs one Hessian solve and usually a single physics solve.
+class Adjoint {
+public:
+	TargetShape target;
+	/// largest change of a section length per step, relative to its length
+	real max_relative_change = 0.1;
+	real min_length = 0.1;
+	/// step for the central differences of the forces with respect to a length, relative to it
+	real fd_epsilon = 1e-6;
+	/// halvings of a step that doesn't decrease the energy before giving up
+	int max_backtracking = 4;
+
+	real last_energy = infinity;
+	/// physics solves of the last step()
+	int last_solves = 0;
+
+	Adjoint();
+	Adjoint(TargetShape target);
+
+	/// TargetShape::energy at the equilibrium stored in ruffle.simulation_mesh.x and its gradient
+	/// with respect to the length of each section in sections()
+	real gradient(Ruffle &ruffle, VectorX &grad);
+	/// one descent step, solves first if the ruffle was never solved,
+	/// returns whether the energy decreased
+	bool step(Ruffle &ruffle);
+
+	/// the optimized sections, all except Section::Type::Regular
+	static vector<listref<Ruffle::Section>> sections(Ruffle &ruffle);
+};
+
+}
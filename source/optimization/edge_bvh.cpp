@@ -0,0 +1,317 @@
+#include "optimization/edge_bvh.h"
+
+#include <algorithm>
+
+namespace ruffles::optimization {
+
+namespace {
+	real cross(Vector2 a, Vector2 b) {
+		return a.x()*b.y() - a.y()*b.x();
+	}
+
+	real segment_distance2(const EdgeBVH::Edge &e, Vector2 p) {
+		Vector2 ab = e.b - e.a;
+		real len2 = ab.squaredNorm();
+		real t = len2 > 0. ? std::clamp((p - e.a).dot(ab) / len2, 0., 1.) : 0.;
+		return (e.a + t*ab - p).squaredNorm();
+	}
+}
+
+EdgeBVH::EdgeBVH(const vector<Vector2> &points) {
+	int n = points.size();
+	if (n < 2) {
+		return;
+	}
+	edges.reserve(n);
+	for (int i = 0; i < n; i++) {
+		edges.push_back({points[i], points[(i+1)%n]});
+	}
+	nodes.reserve(2*n);
+	nodes.push_back({});
+	build(0, 0, n);
+}
+
+void EdgeBVH::build(int node, int begin, int end) {
+	Vector2 lo = Vector2::Constant(infinity), hi = Vector2::Constant(-infinity);
+	Vector2 c_lo = lo, c_hi = hi;
+	for (int i = begin; i < end; i++) {
+		lo = lo.cwiseMin(edges[i].a).cwiseMin(edges[i].b);
+		hi = hi.cwiseMax(edges[i].a).cwiseMax(edges[i].b);
+		Vector2 c = 0.5*(edges[i].a + edges[i].b);
+		c_lo = c_lo.cwiseMin(c);
+		c_hi = c_hi.cwiseMax(c);
+	}
+	nodes[node].min = lo;
+	nodes[node].max = hi;
+
+	if (end - begin <= leaf_size) {
+		nodes[node].first = begin;
+		nodes[node].count = end - begin;
+		return;
+	}
+
+	// median split along the longer axis of the edge centers
+	int axis = (c_hi - c_lo).x() >= (c_hi - c_lo).y() ? 0 : 1;
+	int mid = (begin + end) / 2;
+	std::nth_element(edges.begin() + begin, edges.begin() + mid, edges.begin() + end, [&](const Edge &e, const Edge &f) {
+		return e.a(axis) + e.b(axis) < f.a(axis) + f.b(axis);
+	});
+
+	int children = nodes.size();
+	nodes.push_back({});
+	nodes.push_back({});
+	nodes[node].first = children;
+	nodes[node].count = 0;
+	build(children, begin, mid);
+	build(children+1, mid, end);
+}
+
+real EdgeBVH::box_distance2(const Node &node, Vector2 p) {
+	Vector2 d = (node.min - p).cwiseMax(p - node.max).cwiseMax(0.);
+	return d.squaredNorm();
+}
+
+bool EdgeBVH::box_hit(const Node &node, Vector2 ro, Vector2 d, real t_max) {
+	// slab test
+	real t_min = 0.;
+	for (int k = 0; k < 2; k++) {
+		if (d(k) == 0.) {
+			if (ro(k) < node.min(k) || ro(k) > node.max(k)) {
+				return false;
+			}
+			continue;
+		}
+		real t0 = (node.min(k) - ro(k)) / d(k);
+		real t1 = (node.max(k) - ro(k)) / d(k);
+		t_min = max(t_min, min(t0, t1));
+		t_max = min(t_max, max(t0, t1));
+	}
+	// a ray through a box corner, e.g. aimed at a polygon vertex, gives t_min == t_max up to rounding
+	return t_min <= t_max * (1. + 4. * std::numeric_limits<real>::epsilon());
+}
+
+real EdgeBVH::distance(Vector2 p) const {
+	if (empty()) {
+		return infinity;
+	}
+	real best = infinity;
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node &node = nodes[stack[--top]];
+		if (box_distance2(node, p) >= best) {
+			continue;
+		}
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				best = min(best, segment_distance2(edges[i], p));
+			}
+			continue;
+		}
+		// visit the closer child first
+		int near = node.first, far = node.first+1;
+		if (box_distance2(nodes[far], p) < box_distance2(nodes[near], p)) {
+			std::swap(near, far);
+		}
+		stack[top++] = far;
+		stack[top++] = near;
+	}
+	return sqrt(best);
+}
+
+int EdgeBVH::winding_number(Vector2 p) const {
+	// crossings of the ray from p in +x direction
+	int winding = 0;
+	int stack[64];
+	int top = 0;
+	if (!empty()) {
+		stack[top++] = 0;
+	}
+	while (top > 0) {
+		const Node &node = nodes[stack[--top]];
+		if (p.y() < node.min.y() || p.y() > node.max.y() || p.x() > node.max.x()) {
+			continue;
+		}
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first+1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			const Edge &e = edges[i];
+			real side = cross(e.b - e.a, p - e.a);
+			if (e.a.y() <= p.y()) {
+				if (e.b.y() > p.y() && side > 0.) {
+					winding++;
+				}
+			} else if (e.b.y() <= p.y() && side < 0.) {
+				winding--;
+			}
+		}
+	}
+	return winding;
+}
+
+real EdgeBVH::raycast(Vector2 ro, Vector2 rd) const {
+	real best = infinity;
+	if (empty() || rd.squaredNorm() == 0.) {
+		return best;
+	}
+	Vector2 d = rd.normalized();
+
+	int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node &node = nodes[stack[--top]];
+
+		// the box is behind the ray or further than the current hit
+		if (!box_hit(node, ro, d, best)) {
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first+1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			const Edge &e = edges[i];
+			Vector2 ab = e.b - e.a;
+			Vector2 ao = e.a - ro;
+			real denom = cross(d, ab);
+			// parallel up to rounding, e.g. a ray along the edge it starts on, t would be noise
+			real parallel = 4. * std::numeric_limits<real>::epsilon() * ab.norm();
+			if (std::abs(denom) > parallel) {
+				real t = cross(ao, ab) / denom;
+				real s = cross(ao, d) / denom;
+				if (t >= 0. && s >= 0. && s <= 1.) {
+					best = min(best, t);
+				}
+			} else if (std::abs(cross(ao, d)) <= 4. * std::numeric_limits<real>::epsilon() * (ao.norm() + ab.norm())) {
+				// collinear, the closest point of the overlap
+				real ta = ao.dot(d);
+				real tb = (e.b - ro).dot(d);
+				if (max(ta, tb) >= 0.) {
+					best = min(best, max(0., min(ta, tb)));
+				}
+			}
+		}
+	}
+	return best;
+}
+
+void EdgeBVH::crossings(Vector2 a, Vector2 b, vector<real> &params) const {
+	Vector2 d = b - a;
+	int stack[64];
+	int top = 0;
+	if (!empty()) {
+		stack[top++] = 0;
+	}
+	while (top > 0) {
+		const Node &node = nodes[stack[--top]];
+		if (!box_hit(node, a, d, 1.)) {
+			continue;
+		}
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = node.first+1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			const Edge &e = edges[i];
+			Vector2 ef = e.b - e.a;
+			real denom = cross(d, ef);
+			if (denom == 0.) {
+				continue; // parallel edges don't split the segment
+			}
+			Vector2 ae = e.a - a;
+			real t = cross(ae, ef) / denom;
+			real s = cross(ae, d) / denom;
+			if (t > 0. && t < 1. && s >= 0. && s <= 1.) {
+				params.push_back(t);
+			}
+		}
+	}
+}
+
+real EdgeBVH::signed_area() const {
+	real area = 0.;
+	for (const Edge &e : edges) {
+		area += cross(e.a, e.b);
+	}
+	return 0.5 * area;
+}
+
+real overlap_area(const EdgeBVH &a, const EdgeBVH &b) {
+	// sum of x dy over the pieces of p's boundary inside q, oriented counterclockwise.
+	// Pieces on q's boundary are decided by points slightly to either side: a piece counts if
+	// p's interior side is inside q, and with strict also its exterior side. So boundary parts
+	// shared by a and b with the same orientation are counted once, opposite ones not at all.
+	auto inside_part = [](const EdgeBVH &p, const EdgeBVH &q, bool strict) {
+		real orientation = p.signed_area() < 0. ? -1. : 1.;
+		real sum = 0.;
+		vector<real> params;
+		for (const EdgeBVH::Edge &e : p.edges) {
+			params.assign({0., 1.});
+			q.crossings(e.a, e.b, params);
+			std::sort(params.begin(), params.end());
+			Vector2 d = e.b - e.a;
+			Vector2 offset = 1e-7 * orientation * Vector2(-d.y(), d.x());
+			for (size_t i = 0; i+1 < params.size(); i++) {
+				Vector2 x0 = e.a + params[i] * d;
+				Vector2 x1 = e.a + params[i+1] * d;
+				Vector2 mid = 0.5*(x0 + x1);
+				if (q.winding_number(mid + offset) != 0 && (!strict || q.winding_number(mid - offset) != 0)) {
+					sum += cross(x0, x1);
+				}
+			}
+		}
+		return 0.5 * orientation * sum;
+	};
+	if (a.empty() || b.empty()) {
+		return 0.;
+	}
+	return inside_part(a, b, false) + inside_part(b, a, true);
+}
+
+real overlap_area(const EdgeBVH &a, const vector<Vector2> &b, vector<Vector2> &grad) {
+	int n = b.size();
+	grad.assign(n, Vector2::Zero());
+	EdgeBVH b_index(b);
+	real area = overlap_area(a, b_index);
+	if (a.empty() || b_index.empty()) {
+		return area;
+	}
+
+	// moving the part of an edge inside a changes the overlap by the normal velocity integrated
+	// over that part, the velocity of the point at parameter t is (1-t) db[i] + t db[i+1]
+	real orientation = b_index.signed_area() < 0. ? -1. : 1.;
+	vector<real> params;
+	for (int i = 0; i < n; i++) {
+		Vector2 p = b[i], q = b[(i+1)%n];
+		Vector2 d = q - p;
+		Vector2 offset = 1e-7 * orientation * Vector2(-d.y(), d.x());
+		params.assign({0., 1.});
+		a.crossings(p, q, params);
+		std::sort(params.begin(), params.end());
+
+		real weight_p = 0., weight_q = 0.;
+		for (size_t j = 0; j+1 < params.size(); j++) {
+			real t0 = params[j], t1 = params[j+1];
+			Vector2 mid = p + 0.5*(t0 + t1) * d;
+			// same rule as overlap_area for the second polygon
+			if (a.winding_number(mid + offset) != 0 && a.winding_number(mid - offset) != 0) {
+				weight_q += 0.5*(t1*t1 - t0*t0);
+				weight_p += (t1 - t0) - 0.5*(t1*t1 - t0*t0);
+			}
+		}
+		Vector2 normal = orientation * Vector2(d.y(), -d.x()); // outward, length |d|
+		grad[i] += weight_p * normal;
+		grad[(i+1)%n] += weight_q * normal;
+	}
+	return area;
+}
+
+}
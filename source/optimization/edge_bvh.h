@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common/common.h"
+
+namespace ruffles::optimization {
+
+/// Bounding volume hierarchy over the edges of a closed polygon, all queries in double precision.
+/// Built once, queries are const and can run in parallel.
+class EdgeBVH {
+public:
+	struct Edge {
+		Vector2 a, b;
+	};
+	struct Node {
+		Vector2 min, max;
+		int first; // leaf: first edge, inner: left child (right child is first+1)
+		int count; // number of edges, 0 for inner nodes
+	};
+
+	vector<Edge> edges; // reordered so that every leaf is a contiguous range
+	vector<Node> nodes; // nodes[0] is the root
+
+	static constexpr int leaf_size = 4;
+
+	EdgeBVH() {}
+	/// polygon edges points[i] -> points[(i+1)%n]
+	EdgeBVH(const vector<Vector2> &points);
+
+	bool empty() const {
+		return edges.empty();
+	}
+
+	/// unsigned distance to the closest edge
+	real distance(Vector2 p) const;
+	/// winding number of the polygon around p
+	int winding_number(Vector2 p) const;
+	/// distance along the ray to the first edge hit, infinity if there is none
+	real raycast(Vector2 ro, Vector2 rd) const;
+	/// append the parameters t in (0,1) where a + t*(b-a) crosses an edge, unsorted
+	void crossings(Vector2 a, Vector2 b, vector<real> &params) const;
+	/// positive for counterclockwise polygons
+	real signed_area() const;
+
+private:
+	void build(int node, int begin, int end);
+	static real box_distance2(const Node &node, Vector2 p);
+	/// whether ro + t*d hits the box for some t in [0, t_max]
+	static bool box_hit(const Node &node, Vector2 ro, Vector2 d, real t_max);
+};
+
+/// area of the intersection of two closed polygons (nonzero winding rule), computed as the
+/// boundary integral over the part of each boundary that lies inside the other polygon
+real overlap_area(const EdgeBVH &a, const EdgeBVH &b);
+/// overlap_area(a, EdgeBVH(b)) and its derivative with respect to every vertex b[i] in grad[i]
+real overlap_area(const EdgeBVH &a, const vector<Vector2> &b, vector<Vector2> &grad);
+
+}
@@ -12,21 +12,34 @@ Heuristic::Heuristic(TargetShape target)
  : target(std::move(target)) {
 }
 
+VectorX Heuristic::outline_distances(Ruffle &ruffle) const {
+	int n = 0;
+	for (auto &section : ruffle.sections) {
+		if (section.type == Ruffle::Section::Type::Outline) {
+			n += section.mesh_segments.size();
+		}
+	}
+	MatrixX2 points(n, 2);
+	int i = 0;
+	for (auto &section : ruffle.sections) {
+		if (section.type != Ruffle::Section::Type::Outline)
+			continue;
+		for (auto &seg : section.mesh_segments) {
+			points.row(i++) = ruffle.simulation_mesh.get_vertex_position(*seg->start).transpose();
+		}
+	}
+	return target.signed_distances(points);
+}
+
 void Heuristic::step(Ruffle &ruffle) {
+	VectorX distances = outline_distances(ruffle);
+	int i = 0;
 	for (auto section = ruffle.sections.begin(); section != ruffle.sections.end(); ++section) {
 		if (section->type != Ruffle::Section::Type::Outline)
 			continue;
 		real closest_distance = infinity;
-		for (auto &seg : section->mesh_segments) {
-			auto vertex = seg->start;
-			Vector2 pos = ruffle.simulation_mesh.get_vertex_position(*vertex);
-			
-			//real x = target.intersect_horizontal(pos(1))[(i & 2) ? 0 : 1];
-			closest_distance = min(closest_distance, target.signed_distance(pos));
-			/*if (std::isfinite(x)) {
-				closest_distance = min(closest_distance,
-					(i & 2) ? (pos(0) - x) : (x - pos(0)));
-			}*/
+		for (size_t j = 0; j < section->mesh_segments.size(); j++) {
+			closest_distance = min(closest_distance, distances(i++));
 		}
 		dbg(closest_distance);
 
@@ -54,7 +67,7 @@ void Heuristic::step(Ruffle &ruffle) {
 	}
 
 	ruffle.update_simulation_mesh();
-	ruffle.physics_solve();
+	ruffle.physics_solve(true);
 }
 
 
@@ -78,24 +91,18 @@ void Heuristic::step_inner(Ruffle &ruffle) {
 	}
 
 	ruffle.update_simulation_mesh();
-	ruffle.physics_solve();
+	ruffle.physics_solve(true);
 }
 
 void Heuristic::step_outer(Ruffle &ruffle) {
+	VectorX distances = outline_distances(ruffle);
+	int i = 0;
 	for (auto section = ruffle.sections.begin(); section != ruffle.sections.end(); ++section) {
 		if (section->type != Ruffle::Section::Type::Outline)
 			continue;
 		real closest_distance = infinity;
-		for (auto &seg : section->mesh_segments) {
-			auto vertex = seg->start;
-			Vector2 pos = ruffle.simulation_mesh.get_vertex_position(*vertex);
-			
-			//real x = target.intersect_horizontal(pos(1))[(i & 2) ? 0 : 1];
-			closest_distance = min(closest_distance, target.signed_distance(pos));
-			/*if (std::isfinite(x)) {
-				closest_distance = min(closest_distance,
-					(i & 2) ? (pos(0) - x) : (x - pos(0)));
-			}*/
+		for (size_t j = 0; j < section->mesh_segments.size(); j++) {
+			closest_distance = min(closest_distance, distances(i++));
 		}
 		dbg(closest_distance);
 
@@ -110,7 +117,7 @@ void Heuristic::step_outer(Ruffle &ruffle) {
 	}
 
 	ruffle.update_simulation_mesh();
-	ruffle.physics_solve();
+	ruffle.physics_solve(true);
 }
 
 }
@@ -20,5 +20,10 @@ public:
 	void step(Ruffle &ruffle);
 	void step_inner(Ruffle &ruffle);
 	void step_outer(Ruffle &ruffle);
+
+private:
+	/// signed distance to the target of the start vertex of every outline mesh segment,
+	/// in the order of sections and their mesh_segments
+	VectorX outline_distances(Ruffle &ruffle) const;
 };
 }
@@ -4,26 +4,57 @@
 #include "simulation/lbfgs.h"
 #include "simulation/combination.h"
 
+#include "common/thread_pool.h"
+
 namespace ruffles::optimization {
+
+namespace {
+	bool needs_subdivision(const Ruffle &ruffle, const VectorX &lengths) {
+		int i = 0;
+		for (auto &section : ruffle.sections) {
+			if (lengths(i) / section.mesh_segments.size() > 2*ruffle.h) {
+				return true;
+			}
+			i++;
+		}
+		return false;
+	}
+}
+
 // implement particle
-ParticleSwarm::Particle::Particle(Ruffle &ruffle_)
-	: ruffle(ruffle_.clone()), best(ruffle_.sections.size()), best_value(infinity) {
-	//ruffle.simulator.reset(new simulation::Verlet(ruffle.simulation_mesh));
-	//ruffle.simulator.reset(new simulation::LBFGS(ruffle.simulation_mesh));
-	ruffle.simulator.reset(new simulation::Combination(ruffle.simulation_mesh));
+ParticleSwarm::Particle::Particle(Topology topology, unsigned seed)
+	: topology(topology), positions(topology->simulation_mesh.x), best(topology->sections.size()), best_value(infinity), value(infinity), rng(seed) {
+	//simulator.reset(new simulation::Verlet(topology->simulation_mesh));
+	//simulator.reset(new simulation::LBFGS(topology->simulation_mesh));
+	simulator.reset(new simulation::Combination(topology->simulation_mesh));
 }
 
 void ParticleSwarm::Particle::set_lengths() {
+	if (!needs_subdivision(*topology, x)) {
+		return;
+	}
+	// copy on write, subdivide until loading x into the new topology leaves it unchanged
+	Topology own = std::make_shared<Ruffle>(topology->clone());
+	load(*own, x, positions);
+	while (needs_subdivision(*own, x)) {
+		own->update_simulation_mesh();
+	}
+	positions = own->simulation_mesh.x;
+	topology = own;
+}
+
+void ParticleSwarm::load(Ruffle &ruffle, const VectorX &lengths, const VectorX &positions) {
 	int i = 0;
 	for (auto it = ruffle.sections.begin(); it != ruffle.sections.end(); ++it) {
-		it->length = x(i);
+		it->length = lengths(i);
 		i++;
 	}
+	ruffle.simulation_mesh.x = positions;
 	ruffle.update_simulation_mesh();
 }
 
-ParticleSwarm::ParticleSwarm(TargetShape target_shape, Ruffle &ruffle, int n)
-	: target_shape(target_shape), global_best_value(infinity), global_best_ruffle(nullptr) {
+ParticleSwarm::ParticleSwarm(TargetShape target_shape, Ruffle &ruffle, int n, unsigned seed)
+	: target_shape(target_shape), global_best_value(infinity) {
 	m = ruffle.sections.size();
 	VectorX x0(m);
 
@@ -36,17 +67,23 @@ ParticleSwarm::ParticleSwarm(TargetShape target_shape, Ruffle &ruffle, int n)
 	VectorX lb = 0.5 * x0;
 	VectorX ub = 1.5 * x0;
 
+	Topology topology = std::make_shared<Ruffle>(ruffle.clone());
+
+	particles.reserve(n);
+	std::seed_seq seeds{seed};
+	vector<unsigned> particle_seeds(n);
+	seeds.generate(particle_seeds.begin(), particle_seeds.end());
 	for (int i = 0; i < n; i++) {
-		particles.emplace_back(ruffle);
-		Particle &particle = particles.back();
-		VectorX x = lb + random_vector(m).cwiseProduct(ub-lb);
-		particle.x = x;
+		particles.emplace_back(topology, particle_seeds[i]);
+	}
+
+	ThreadPool::instance().parallel_for(n, [&](int i) {
+		Particle &particle = particles[i];
+		particle.x = lb + random_vector(m, particle.rng).cwiseProduct(ub-lb);
 		// ?
 		particle.v = VectorX::Zero(m);
 		particle.set_lengths();
-
-		//particles.push_back(particle);
-	}
+	});
 
 	physics_solve();
 	update_best();
@@ -54,43 +91,64 @@ ParticleSwarm::ParticleSwarm(TargetShape target_shape, Ruffle &ruffle, int n)
 
 void ParticleSwarm::update_best() {
 	for (auto &particle : particles) {
-		real value = target_shape.energy(particle.ruffle);
-		if (value < particle.best_value) {
-			particle.best_value = value;
+		if (particle.value < particle.best_value) {
+			particle.best_value = particle.value;
 			particle.best = particle.x;
-			if (value < global_best_value) {
-				global_best_value = value;
-				global_best = particle.x;
-				global_best_ruffle = &particle.ruffle;
-			}
+		}
+		if (particle.value < global_best_value) {
+			global_best_value = particle.value;
+			global_best = particle.x;
+			global_best_topology = particle.topology;
+			global_best_positions = particle.positions;
 		}
 	}
 }
 
 void ParticleSwarm::physics_solve() {
-	int i = 0;
 	cerr << "Solving " << particles.size() << " ruffles!" << endl;
-	// TODO: parallelize
-	for (auto &particle : particles) {
-		particle.ruffle.physics_solve();
-		i++;
-		cerr << i << "/" << particles.size() << endl;
+	ThreadPool &pool = ThreadPool::instance();
+	if ((int)workspaces.size() < pool.slots()) {
+		workspaces.resize(pool.slots());
 	}
+	pool.parallel_for(particles.size(), [&](int i, int slot) {
+		Particle &particle = particles[i];
+		Workspace &workspace = workspaces[slot];
+		if (workspace.topology != particle.topology) {
+			workspace.ruffle = particle.topology->clone();
+			workspace.topology = particle.topology;
+		}
+		Ruffle &ruffle = workspace.ruffle;
+		load(ruffle, particle.x, particle.positions);
+
+		ruffle.simulator.swap(particle.simulator);
+		ruffle.physics_solve(true);
+		ruffle.simulator.swap(particle.simulator);
+
+		particle.positions = ruffle.simulation_mesh.x;
+		particle.value = target_shape.energy(ruffle);
+	});
 }
 
 void ParticleSwarm::step() {
-	for (auto &particle : particles) {
+	ThreadPool::instance().parallel_for(particles.size(), [&](int i) {
+		Particle &particle = particles[i];
 		particle.v =
 			omega*particle.v
-		      + phi_p*random_vector(m).cwiseProduct(particle.best-particle.x)
-		      + phi_g*random_vector(m).cwiseProduct(global_best  -particle.x);
+		      + phi_p*random_vector(m, particle.rng).cwiseProduct(particle.best-particle.x)
+		      + phi_g*random_vector(m, particle.rng).cwiseProduct(global_best  -particle.x);
 		particle.x += learning_rate * particle.v;
 		particle.set_lengths();
-	}
+	});
 
 	physics_solve();
 	update_best();
 }
 
+Ruffle ParticleSwarm::global_best_ruffle() {
+	Ruffle res = global_best_topology->clone();
+	load(res, global_best, global_best_positions);
+	return res;
+}
+
 
 }
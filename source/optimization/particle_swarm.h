@@ -8,19 +8,34 @@
 
 namespace ruffles::optimization {
 
+/// Particles share the topology (sections, connection points and mesh) of the ruffle they were
+/// created from and only own their lengths, positions and solver state. A particle gets its own
+/// copy of the topology once its lengths make update_simulation_mesh subdivide a section.
 class ParticleSwarm {
 public:
+	/// never modified once particles refer to it
+	using Topology = shared_ptr<Ruffle>;
+
 	struct Particle {
-		Ruffle ruffle;
+		Topology topology;
+		/// simulation_mesh.x of this particle, in the numbering of topology
+		VectorX positions;
+		unique_ptr<simulation::Simulator> simulator;
 
 		VectorX x;
 		VectorX v;
 
 		VectorX best;
 		real best_value;
+		/// energy of the current x, set by physics_solve()
+		real value;
+
+		/// own stream so that results don't depend on the thread schedule
+		std::mt19937 rng;
 
-		Particle(Ruffle &ruffle_);
+		Particle(Topology topology, unsigned seed);
 
+		/// clone the topology if the lengths x would subdivide it
 		void set_lengths();
 	};
 
@@ -30,8 +45,8 @@ public:
 	vector<Particle> particles;
 	VectorX global_best;
 	real global_best_value;
-
-	Ruffle *global_best_ruffle;
+	Topology global_best_topology;
+	VectorX global_best_positions;
 
 	real omega = 1.0;
 	real phi_p = 2.0;
@@ -40,13 +55,29 @@ public:
 	real learning_rate = 1.0;
 
 
-	ParticleSwarm(TargetShape target_shape, Ruffle &ruffle, int n);
+	ParticleSwarm(TargetShape target_shape, Ruffle &ruffle, int n, unsigned seed = 0);
 
+	/// reduce the particle values into the global best, ties go to the lower index
 	void update_best();
 
+	/// solve every particle and evaluate its energy, in parallel on the shared ThreadPool
 	void physics_solve();
 
 	void step();
+
+	/// standalone ruffle with the lengths and positions of the global best
+	Ruffle global_best_ruffle();
+
+private:
+	/// a ruffle for solving particles of one topology, reused by one thread of the pool
+	struct Workspace {
+		Topology topology;
+		Ruffle ruffle;
+	};
+	vector<Workspace> workspaces;
+
+	/// write lengths and positions into ruffle, which has the given topology
+	static void load(Ruffle &ruffle, const VectorX &lengths, const VectorX &positions);
 };
 
 }
@@ -1,8 +1,11 @@
 #include "optimization/target_shape.h"
+#include "common/thread_pool.h"
 
 #include <CGAL/Triangulation_vertex_base_with_info_2.h>
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
 
+#include <igl/parallel_for.h>
+
 namespace ruffles::optimization {
 
 typedef CGAL::Triangulation_data_structure_2<
@@ -15,14 +18,16 @@ typedef CGAL::Constrained_Delaunay_triangulation_2<K,TriangulationDataStructure>
 
 
 using ruffles::K;
-typedef CGAL::Direction_2<K> Direction;
-typedef CGAL::Ray_2<K> Ray;
-typedef CGAL::Line_2<K> Line;
-typedef CGAL::Segment_2<K> Segment;
+// queries only need predicates and construct nothing that is reused
+typedef CGAL::Point_2<QueryKernel> QueryPoint;
+typedef CGAL::Line_2<QueryKernel> Line;
+typedef CGAL::Segment_2<QueryKernel> Segment;
 
 TargetShape::TargetShape() {}
 
 TargetShape::TargetShape(Polygon target) : target(target) {
+	build_query_structures();
+
 	CDT cdt;
 	unsigned n = target.size();
 	vector<CDT::Vertex_handle> vertices;
@@ -80,15 +85,29 @@ TargetShape::TargetShape(Eigen::MatrixXd &cut_shape, Vector3 origin, Vector3 u_d
 		real v = x.dot(v_dir) - ov;
 		target.push_back(Point(u,v));
 	}
+	build_query_structures();
 }
 
-real TargetShape::energy(Ruffle &ruffle) {
-	Polygon outline;
+void TargetShape::build_query_structures() {
+	target_query = convert_polygon<QueryKernel>(target);
+
+	vector<Vector2> points;
+	points.reserve(target.size());
+	for (auto it = target.vertices_begin(); it != target.vertices_end(); ++it) {
+		points.emplace_back(CGAL::to_real(it->x()), CGAL::to_real(it->y()));
+	}
+	edge_index = EdgeBVH(points);
+	target_area = CGAL::to_real(target.area());
+}
+
+real TargetShape::energy(Ruffle &ruffle, VectorX *grad) {
+	vector<Vector2> outline;
+	vector<simulation::SimulationMesh::Vertex*> outline_vertices;
 	for (auto outline_section : ruffle.outline_sections) {
 		auto &segments = outline_section.section->mesh_segments;
 		auto push_vertex = [&](simulation::SimulationMesh::Vertex &v) {
-			Vector2 x = ruffle.simulation_mesh.get_vertex_position(v);
-			outline.push_back(Point(x(0), x(1)));
+			outline.push_back(ruffle.simulation_mesh.get_vertex_position(v));
+			outline_vertices.push_back(&v);
 		};
 		if (outline_section.reversed) {
 			for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
@@ -101,15 +120,41 @@ real TargetShape::energy(Ruffle &ruffle) {
 		}
 	}
 
-	real outline_area = CGAL::to_real(outline.area());
-	// cache?
-	real target_area =  CGAL::to_real(target.area());
+	real outline_area = 0.;
+	for (size_t i = 0; i < outline.size(); i++) {
+		Vector2 a = outline[i];
+		Vector2 b = outline[(i+1) % outline.size()];
+		outline_area += 0.5 * (a.x()*b.y() - a.y()*b.x());
+	}
 
-	vector<PolygonWithHoles> intersection;
-	CGAL::intersection(target, outline, std::back_inserter(intersection));
 	real intersection_area = 0.;
-	for (auto its : intersection) {
-		intersection_area += CGAL::to_real(its.outer_boundary().area());
+	if (grad) {
+		// d/dp of the shoelace sum and of the overlap
+		vector<Vector2> intersection_grad;
+		intersection_area = overlap_area(edge_index, outline, intersection_grad);
+
+		int n = outline.size();
+		grad->setZero(ruffle.simulation_mesh.dof());
+		for (int i = 0; i < n; i++) {
+			Vector2 prev = outline[(i+n-1) % n];
+			Vector2 next = outline[(i+1) % n];
+			Vector2 outline_grad = 0.5 * Vector2(next.y() - prev.y(), prev.x() - next.x());
+			if (int *ix = std::get_if<int>(outline_vertices[i])) {
+				grad->segment<2>(2**ix) += lambda*outline_grad - (k+lambda)*intersection_grad[i];
+			}
+		}
+	} else if (exact_energy) {
+		Polygon outline_polygon;
+		for (Vector2 x : outline) {
+			outline_polygon.push_back(Point(x(0), x(1)));
+		}
+		vector<PolygonWithHoles> intersection;
+		CGAL::intersection(target, outline_polygon, std::back_inserter(intersection));
+		for (auto its : intersection) {
+			intersection_area += CGAL::to_real(its.outer_boundary().area());
+		}
+	} else {
+		intersection_area = overlap_area(edge_index, EdgeBVH(outline));
 	}
 
 	return k*(target_area-intersection_area) + lambda*(outline_area-intersection_area);
@@ -121,7 +166,7 @@ array<real,2> TargetShape::intersect_horizontal(real height) {
 	// appearently we have to implement every little thing ourselves :/
 	real x_min = infinity;
 	real x_max = -infinity;
-	for (auto it = target.edges_begin(); it != target.edges_end(); ++it) {
+	for (auto it = target_query.edges_begin(); it != target_query.edges_end(); ++it) {
 		auto its = CGAL::intersection(line, *it);
 		if (its) {
 			if (Segment* seg = boost::get<Segment>(&*its)) {
@@ -130,7 +175,7 @@ array<real,2> TargetShape::intersect_horizontal(real height) {
 				x_min = min(x_min, min(x0,x1));
 				x_max = max(x_max, max(x0,x1));
 			}
-			if (Point* point = boost::get<Point>(&*its)) {
+			if (QueryPoint* point = boost::get<QueryPoint>(&*its)) {
 				x_min = min(x_min, CGAL::to_real(point->x()));
 				x_max = max(x_max, CGAL::to_real(point->x()));
 			}
@@ -156,39 +201,25 @@ real TargetShape::avg_width() {
 	return abs(CGAL::to_real(target.area())) / height();
 }
 
-real TargetShape::signed_distance(Vector2 pos) {
-	real min_dist = infinity;
-	Point point(pos.x(), pos.y());
-	for (auto it = target.edges_begin(); it != target.edges_end(); ++it) {
-		auto dist2 = CGAL::squared_distance(point, *it);
-		real dist = sqrt(CGAL::to_real(dist2));
+real TargetShape::signed_distance(Vector2 pos) const {
+	real dist = edge_index.distance(pos);
+	return contains(pos) ? dist : -dist;
+}
 
-		min_dist = min(min_dist, dist);
-	}
-	if (target.has_on_unbounded_side(point)) {
-		min_dist *= -1;
-	}
-	return min_dist;
+VectorX TargetShape::signed_distances(const MatrixX2 &points) const {
+	VectorX res(points.rows());
+	igl::parallel_for(points.rows(), [&](int i) {
+		res(i) = signed_distance(points.row(i).transpose());
+	}, parallel_threshold(1000));
+	return res;
 }
 
-real TargetShape::raycast(Vector2 ro, Vector2 rd) {
-	real t = infinity;
+bool TargetShape::contains(Vector2 pos) const {
+	return edge_index.winding_number(pos) != 0;
+}
 
-	Point source(ro.x(), ro.y());
-	Ray ray(source, Direction(rd.x(), rd.y()));
-	for (auto it = target.edges_begin(); it != target.edges_end(); ++it) {
-		auto its = CGAL::intersection(ray, *it);
-		if (its) {
-			if (Segment* seg = boost::get<Segment>(&*its)) {
-				t = min(t, sqrt(CGAL::to_real(CGAL::squared_distance(source, seg->vertex(0)))));
-				t = min(t, sqrt(CGAL::to_real(CGAL::squared_distance(source, seg->vertex(1)))));
-			}
-			if (Point* point = boost::get<Point>(&*its)) {
-				t = min(t, sqrt(CGAL::to_real(CGAL::squared_distance(source, *point))));
-			}
-		}
-	}
-	return t;
+real TargetShape::raycast(Vector2 ro, Vector2 rd) const {
+	return edge_index.raycast(ro, rd);
 }
 
 }
@@ -2,6 +2,7 @@
 
 #include "common/common.h"
 #include "common/cgal_util.h"
+#include "optimization/edge_bvh.h"
 
 namespace ruffles::optimization {
 	class TargetShape;
@@ -14,6 +15,10 @@ namespace ruffles::optimization {
 class TargetShape {
 public:
 	Polygon target;
+	/// target in the query kernel for intersect_horizontal, set by the constructors from target
+	CGAL::Polygon_2<QueryKernel> target_query;
+	/// edges of target for signed_distance, contains and raycast, set by the constructors
+	EdgeBVH edge_index;
 
 	Matrix<real, -1, -1> V;
 	Matrix<int, -1, -1> F;
@@ -24,6 +29,8 @@ public:
 
 	real k = 1.0;
 	real lambda = 1e3;
+	/// compute the overlap in energy() without grad with exact CGAL booleans instead of edge_index
+	bool exact_energy = false;
 
 	TargetShape();
 	TargetShape(Polygon);
@@ -32,10 +39,21 @@ public:
 	real height();
 	real avg_width();
 
-	real energy(Ruffle &ruffle);
+	/// With grad, also the derivative with respect to ruffle.simulation_mesh.x,
+	/// the overlap is then always computed in double precision.
+	real energy(Ruffle &ruffle, VectorX *grad = nullptr);
 	array<real,2> intersect_horizontal(real height);
-	real signed_distance(Vector2 pos);
-	real raycast(Vector2 ro, Vector2 rd);
+	/// positive inside the target, negative outside
+	real signed_distance(Vector2 pos) const;
+	/// signed_distance of every row, evaluated in parallel
+	VectorX signed_distances(const MatrixX2 &points) const;
+	bool contains(Vector2 pos) const;
+	real raycast(Vector2 ro, Vector2 rd) const;
+
+private:
+	real target_area = 0.;
+
+	void build_query_structures();
 };
 
 }
@@ -6,6 +6,7 @@
 
 namespace ruffles {
 
+/// document of write_svg, for files use export_patterns which doesn't build the document
 unique_ptr<tinyxml2::XMLDocument> create_svg(Ruffle &ruffle);
 
 }
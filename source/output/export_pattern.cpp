@@ -0,0 +1,202 @@
+#include "export_pattern.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+#include "common/thread_pool.h"
+
+
+namespace ruffles {
+
+
+namespace {
+
+// every cubic piece of a connector becomes this many lines in formats without curves
+constexpr int curve_steps = 8;
+
+vector<Vector2> flatten_tab() {
+    vector<Vector2> res = {Pattern::tab_start};
+    for (auto &piece : Pattern::tab) {
+        if (!piece.curve) {
+            res.push_back(piece.end);
+            continue;
+        }
+        Vector2 p0 = res.back();
+        for (int i = 1; i <= curve_steps; i++) {
+            real t = real(i) / curve_steps;
+            real s = 1. - t;
+            res.push_back(s*s*s*p0 + 3.*s*s*t*piece.c1 + 3.*s*t*t*piece.c2 + t*t*t*piece.end);
+        }
+    }
+    return res;
+}
+
+void write_point(std::ostream &out, const Vector2 &p) {
+    out << p.x() << "," << p.y();
+}
+
+// one DXF group, a code followed by its value on the next line
+template<typename T>
+void group(std::ostream &out, int code, const T &value) {
+    out << code << "\n" << value << "\n";
+}
+
+void dxf_point(std::ostream &out, const Vector2 &p, int code = 10) {
+    group(out, code, p.x());
+    group(out, code+10, p.y());
+    group(out, code+20, 0.);
+}
+
+void dxf_polyline(std::ostream &out, const vector<Vector2> &points, bool closed, const char *layer, int color) {
+    group(out, 0, "POLYLINE");
+    group(out, 8, layer);
+    group(out, 62, color);
+    group(out, 66, 1);
+    group(out, 70, closed ? 1 : 0);
+    dxf_point(out, Vector2::Zero());
+    for (auto &p : points) {
+        group(out, 0, "VERTEX");
+        group(out, 8, layer);
+        dxf_point(out, p);
+    }
+    group(out, 0, "SEQEND");
+    group(out, 8, layer);
+}
+
+}
+
+void write_svg(const Pattern &pattern, std::ostream &out) {
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\""
+        << " width=\"" << pattern.width << "cm\" height=\"" << pattern.height << "cm\""
+        << " viewBox=\"0 0 " << pattern.width << " " << pattern.height << "\">\n";
+    out << "<g fill=\"none\" stroke=\"red\" stroke-width=\"0.001\""
+        << " transform=\"translate(" << pattern.offset.x() << " " << pattern.offset.y() << ")\">\n";
+
+    for (auto &connector : pattern.connectors) {
+        out << "<g transform=\"translate(" << connector.position << " " << connector.center << ")"
+            << " scale(" << connector.scale << ")\">";
+        if (connector.tab) {
+            out << "<path d=\"M";
+            write_point(out, Pattern::tab_start);
+            for (auto &piece : Pattern::tab) {
+                if (piece.curve) {
+                    out << " C";
+                    write_point(out, piece.c1);
+                    out << " ";
+                    write_point(out, piece.c2);
+                    out << " ";
+                } else {
+                    out << " L";
+                }
+                write_point(out, piece.end);
+            }
+            out << "\"/>";
+        } else {
+            out << "<polyline points=\"";
+            for (auto &p : Pattern::slot) {
+                write_point(out, p);
+                out << " ";
+            }
+            out << "\"/>";
+        }
+        out << "<text stroke=\"#00ff00\" fill=\"none\">" << connector.label << "</text>";
+        out << "<line y1=\"" << -Pattern::mark_length << "\" y2=\"" << Pattern::mark_length << "\" stroke=\"black\"/>";
+        out << "</g>\n";
+    }
+
+    if (!pattern.outline.empty()) {
+        out << "<polygon points=\"";
+        for (auto &p : pattern.outline) {
+            write_point(out, p);
+            out << " ";
+        }
+        out << "\"/>\n";
+    }
+
+    out << "</g>\n</svg>\n";
+}
+
+void write_dxf(const Pattern &pattern, std::ostream &out) {
+    static const vector<Vector2> tab = flatten_tab();
+
+    // page coordinates with y upwards
+    auto page = [&](const Vector2 &p) {
+        return Vector2(p.x() + pattern.offset.x(), pattern.height - (p.y() + pattern.offset.y()));
+    };
+
+    group(out, 0, "SECTION");
+    group(out, 2, "HEADER");
+    group(out, 9, "$INSUNITS");
+    group(out, 70, 5); // cm
+    group(out, 0, "ENDSEC");
+
+    group(out, 0, "SECTION");
+    group(out, 2, "ENTITIES");
+
+    vector<Vector2> points;
+    for (auto &connector : pattern.connectors) {
+        auto place = [&](const Vector2 &p) {
+            return page(Vector2(connector.position, connector.center) + connector.scale * p);
+        };
+
+        points.clear();
+        for (auto &p : connector.tab ? tab : Pattern::slot) {
+            points.push_back(place(p));
+        }
+        dxf_polyline(out, points, false, "CUT", 1);
+
+        group(out, 0, "TEXT");
+        group(out, 8, "LABEL");
+        group(out, 62, 3);
+        dxf_point(out, place(Vector2::Zero()));
+        group(out, 40, connector.scale * Pattern::label_size);
+        group(out, 1, connector.label);
+
+        group(out, 0, "LINE");
+        group(out, 8, "MARK");
+        group(out, 62, 7);
+        dxf_point(out, place(Vector2(0., -Pattern::mark_length)));
+        dxf_point(out, place(Vector2(0., Pattern::mark_length)), 11);
+    }
+
+    if (!pattern.outline.empty()) {
+        points.clear();
+        for (auto &p : pattern.outline) {
+            points.push_back(page(p));
+        }
+        dxf_polyline(out, points, true, "CUT", 1);
+    }
+
+    group(out, 0, "ENDSEC");
+    group(out, 0, "EOF");
+}
+
+void export_patterns(const vector<Ruffle*> &ruffles, const string &directory, int formats, const string &prefix) {
+    std::filesystem::create_directories(directory);
+
+    ThreadPool::instance().parallel_for(ruffles.size(), [&](int i) {
+        if (ruffles[i]->sections.empty()) {
+            return;
+        }
+        Pattern pattern = create_pattern(*ruffles[i]);
+
+        auto write = [&](const char *extension, void (*writer)(const Pattern&, std::ostream&)) {
+            auto fname = (std::filesystem::path(directory) / (prefix + to_string(i) + extension)).string();
+            std::ofstream out(fname);
+            out << std::setprecision(8);
+            writer(pattern, out);
+            if (!out) {
+                throw std::runtime_error("Could not write " + fname);
+            }
+        };
+        if (formats & SVG) {
+            write(".svg", write_svg);
+        }
+        if (formats & DXF) {
+            write(".dxf", write_dxf);
+        }
+    });
+}
+
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <ostream>
+#include "common/common.h"
+#include "output/pattern.h"
+
+namespace ruffles {
+
+enum PatternFormat {
+    SVG = 1,
+    DXF = 2,
+};
+
+/// write the pattern directly to out without building a document first,
+/// numbers are written with the precision of out
+void write_svg(const Pattern &pattern, std::ostream &out);
+/// ASCII DXF (R12 entities) in cm with y upwards, the cut outline and connectors on layer CUT,
+/// labels on LABEL and the connector marks on MARK
+void write_dxf(const Pattern &pattern, std::ostream &out);
+
+/// write <directory>/<prefix><i>.svg and/or .dxf for every ruffle that has sections, in parallel
+/// on the shared ThreadPool. Throws std::runtime_error if a file can't be written.
+void export_patterns(const vector<Ruffle*> &ruffles, const string &directory, int formats = SVG, const string &prefix = "part");
+
+}
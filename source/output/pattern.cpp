@@ -0,0 +1,120 @@
+#include "pattern.h"
+
+#include "common/clone_helper.h"
+
+
+namespace ruffles {
+
+
+constexpr real min_width = 4.; // 2cm
+constexpr real max_connector_width = 2.;
+constexpr real connector_template_width = 42.52;
+
+const Vector2 Pattern::tab_start(-4.62, 20.89);
+const vector<Pattern::Piece> Pattern::tab = {
+    {false, {}, {}, {0.21, 20.89}},
+    {false, {}, {}, {0.21, 26.93}},
+    {true, {0.21, 28.23}, {1.10, 29.37}, {2.36, 29.68}},
+    {true, {3.62, 29.99}, {4.94, 29.40}, {5.55, 28.25}},
+    {false, {}, {}, {19.73, 1.32}},
+    {true, {19.95, 0.91}, {20.06, 0.45}, {20.06, 0.}},
+    {true, {20.06, -0.45}, {19.95, -0.91}, {19.73, -1.32}},
+    {false, {}, {}, {5.56, -28.25}},
+    {true, {4.95, -29.40}, {3.64, -29.99}, {2.37, -29.68}},
+    {true, {1.10, -29.37}, {0.22, -28.23}, {0.22, -26.93}},
+    {false, {}, {}, {0.22, -21.63}},
+    {false, {}, {}, {-4.61, -21.63}},
+};
+const vector<Vector2> Pattern::slot = {
+    {-5.97, -27.62}, {0., -21.65}, {0., 20.87}, {-5.97, 26.84},
+};
+
+Pattern create_pattern(Ruffle &ruffle) {
+    Pattern pattern;
+
+    vector<Vector2> points_upper, points_lower;
+    bool first = true;
+    real l = 0.;
+    real min_z = infinity;
+    real max_z = -infinity;
+    auto add_vertex = [&](auto vx) {
+        real z0 = vx->z.front();
+        real z1 = vx->z.back();
+        if (z1 < z0 + min_width) {
+            real d = min_width-(z1-z0);
+            z0 -= 0.5*d;
+            z1 += 0.5*d;
+        }
+        min_z = min(min_z, z0);
+        max_z = max(max_z, z1);
+        points_upper.emplace_back(l, z0);
+        points_lower.emplace_back(l, z1);
+    };
+
+    std::unordered_map<listref<Ruffle::ConnectionPoint>,int,listref_hash<Ruffle::ConnectionPoint>> seen;
+    int last = 0;
+    auto add_connection = [&](auto cp) {
+        if (cp->connecting_segments[0].size() + cp->connecting_segments[1].size() <= 2) {
+            return;
+        }
+        auto z0 = cp->mesh_vertex->z.front();
+        auto z1 = cp->mesh_vertex->z.back();
+        real zm = 0.5*(z0+z1);
+        real w = max(min_width, z1-z0);
+        real connector_width = min(max_connector_width, 0.38 * w);
+
+        Pattern::Connector connector;
+        connector.position = l;
+        connector.center = zm;
+        connector.scale = connector_width / connector_template_width;
+        if (auto it = seen.find(cp); it != seen.end()) {
+            connector.label = it->second;
+            connector.tab = false;
+        } else {
+            connector.label = ++last;
+            connector.tab = true;
+            seen.emplace(cp, connector.label);
+        }
+        pattern.connectors.push_back(connector);
+    };
+    for (auto &section : ruffle.sections) {
+        if (first) {
+            add_connection(section.start);
+        }
+        for (auto segment : section.mesh_segments) {
+            if (first) {
+                first = false;
+                add_vertex(segment->start);
+            }
+            //l += segment->length;
+            l += (ruffle.simulation_mesh.get_vertex_position(*segment->end)
+                - ruffle.simulation_mesh.get_vertex_position(*segment->start)).norm();
+            add_vertex(segment->end);
+        }
+        add_connection(section.end);
+    }
+
+    if (points_upper.empty()) {
+        return pattern;
+    }
+
+    auto &points = pattern.outline;
+    points.reserve(2*points_upper.size() + 4);
+    for (auto it = points_upper.begin(); it != points_upper.end(); ++it) {
+        points.push_back(*it);
+    }
+    points.push_back(points_upper.back() + Vector2(1.,0));
+    points.push_back(points_lower.back() + Vector2(1.,0));
+    for (auto it = points_lower.rbegin(); it != points_lower.rend(); ++it) {
+        points.push_back(*it);
+    }
+    points.push_back(points_lower.front() + Vector2(-1.,0));
+    points.push_back(points_upper.front() + Vector2(-1.,0));
+
+    pattern.height = max_z - min_z + 0.2; // 1mm margin both sides
+    pattern.width = l + 2.2; // 1cm connector + 1mm margin both sides
+    pattern.offset = Vector2(1.1, -min_z+0.1);
+    return pattern;
+}
+
+}
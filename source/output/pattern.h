@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common/common.h"
+#include "ruffle/ruffle.h"
+
+namespace ruffles {
+
+/// Cutting pattern of the fabric strip of a ruffle, in cm. The strip runs along x, y is the
+/// height on the fabric (downwards like in svg). Shared by all output formats.
+struct Pattern {
+    /// mark where a connection point sits on the strip, drawn with the connector template
+    struct Connector {
+        real position; // along the strip
+        real center;   // middle of the strip there
+        real scale;    // of the connector template
+        int label;     // same for both ends of a connection
+        bool tab;      // first occurrence of the connection point, the other end gets a slot
+    };
+
+    vector<Vector2> outline; // closed polygon
+    vector<Connector> connectors;
+
+    // page size including margins, add offset to the coordinates above
+    real width = 0.;
+    real height = 0.;
+    Vector2 offset = Vector2::Zero();
+
+    /// connector template, a tab is an open path of lines and cubic bezier pieces
+    struct Piece {
+        bool curve;
+        Vector2 c1, c2; // control points of curves
+        Vector2 end;
+    };
+    static const Vector2 tab_start;
+    static const vector<Piece> tab;
+    static const vector<Vector2> slot;
+    /// height of the label text in template units
+    static constexpr real label_size = 16.;
+    /// half length of the line through every connector in template units
+    static constexpr real mark_length = 100.;
+};
+
+Pattern create_pattern(Ruffle &ruffle);
+
+}
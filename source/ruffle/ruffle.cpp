@@ -1,4 +1,5 @@
 #include "ruffle/ruffle.h"
+#include "ruffle/ruffle_format.h"
 
 #include <unordered_set>
 
@@ -30,11 +31,14 @@ void Ruffle::update_simulation_mesh() {
 			listref<SimulationMesh::Segment> old_first = section.mesh_segments.front();
 			listref<SimulationMesh::Segment> old_last  = section.mesh_segments.back();
 
+			int n = section.mesh_segments.size();
+			SimulationMesh::Builder builder(simulation_mesh, n, 2*n);
 			for (auto it = section.mesh_segments.begin(); it != section.mesh_segments.end(); ++it) {
 				auto [a,b] = simulation_mesh.split_segment(*it);
 				new_mesh_segments.push_back(a);
 				new_mesh_segments.push_back(b);
 			}
+			builder.finish();
 			section.mesh_segments = new_mesh_segments;
 
 			listref<SimulationMesh::Segment> new_first = section.mesh_segments.front();
@@ -123,6 +127,8 @@ Section Ruffle::create_section(listref<ConnectionPoint> a, listref<ConnectionPoi
 	real segment_length = length / num_segments;
 
 	Section section(a, b, length);
+	section.mesh_segments.reserve(num_segments);
+	SimulationMesh::Builder builder(simulation_mesh, num_segments-1, num_segments);
 
 	listref<Vertex> prev_vertex = a->mesh_vertex;
 
@@ -207,6 +213,7 @@ void Ruffle::create_connection_bends() {
 		i++;
 		}
 	}
+	simulation_mesh.invalidate_compiled();
 }
 
 listref<Section> Ruffle::subdivide(listref<Section> section) {
@@ -259,6 +266,7 @@ listref<Section> Ruffle::subdivide(listref<Section> section) {
 
 listref<Section> Ruffle::densify(listref<Section> section) {
 	simulation_mesh.air_mesh.clear();
+	SimulationMesh::Builder builder(simulation_mesh);
 
 	assert(section != sections.begin());
 	assert(section != std::prev(sections.end()));
@@ -344,7 +352,8 @@ listref<Section> Ruffle::densify(listref<Section> section) {
 		}
 		simulation_mesh.segments.erase(*it);
 	}
-	simulation_mesh.cleanup();
+	builder.finish();
+	cleanup_simulation_mesh();
 
 	// update outline
 	listref<OutlineSection> in_outline = std::find(outline_sections.begin(), outline_sections.end(), section);
@@ -387,7 +396,7 @@ void Ruffle::delete_section(listref<Section> section) {
 		}
 		simulation_mesh.segments.erase(*it);
 	}
-	simulation_mesh.cleanup();
+	cleanup_simulation_mesh();
 
 	sections.erase(section);
 }
@@ -431,6 +440,7 @@ Vector2 Ruffle::get_tangent(ConnectionPoint &p) {
 
 listref<Section> Ruffle::densify2(listref<Section> section) {
 	simulation_mesh.air_mesh.clear();
+	SimulationMesh::Builder builder(simulation_mesh);
 	
 	section = subdivide(section);
 	auto a = section->start;
@@ -479,6 +489,7 @@ listref<Section> Ruffle::densify3(listref<Section> section) {
 	if (section == std::prev(sections.end())) return section;
 
 	simulation_mesh.air_mesh.clear();
+	SimulationMesh::Builder builder(simulation_mesh);
 
 
 	std::unordered_set<listref<ConnectionPoint>, listref_hash<ConnectionPoint>> visited_vertices;
@@ -635,7 +646,8 @@ listref<Section> Ruffle::densify3(listref<Section> section) {
 		}
 		simulation_mesh.segments.erase(*it);
 	}
-	simulation_mesh.cleanup();
+	builder.finish();
+	cleanup_simulation_mesh();
 
 	// update outline
 	listref<OutlineSection> in_outline = std::find(outline_sections.begin(), outline_sections.end(), section);
@@ -665,6 +677,7 @@ Ruffle Ruffle::create_ruffle_stack(int steps, real height, real width, real h) {
 	dbg(height);
 	Ruffle res;
 	res.h = h;
+	SimulationMesh::Builder builder(res.simulation_mesh);
 
 	real diagonal = hypot(width, height);
 	real semicircle = 0.5*M_PI*height;
@@ -742,6 +755,7 @@ Ruffle Ruffle::create_ruffle_stack(int steps, real height, real width, real h) {
 	//res.dissolve_connection_point(bl); // actually top left vertex
 	//res.dissolve_connection_point(original_br);
 
+	builder.finish();
 	res.create_connection_bends();
 	res.update_simulation_mesh();
 
@@ -752,6 +766,7 @@ Ruffle Ruffle::create_ruffle_stack(int steps, real height, real width, real h) {
 Ruffle Ruffle::create_horizontal_stack(int steps, real height, real width, real h) {
 	Ruffle res;
 	res.h = h;
+	SimulationMesh::Builder builder(res.simulation_mesh);
 
 	real diagonal = hypot(width, height);
 	real semicircle = 0.5*M_PI*width;
@@ -815,6 +830,7 @@ Ruffle Ruffle::create_horizontal_stack(int steps, real height, real width, real
 	res.dissolve_connection_point(bl); // actually top left vertex
 	res.dissolve_connection_point(original_br);
 
+	builder.finish();
 	res.create_connection_bends();
 	res.update_simulation_mesh();
 
@@ -824,6 +840,7 @@ Ruffle Ruffle::create_horizontal_stack(int steps, real height, real width, real
 Ruffle Ruffle::create_stack_along_curve(MatrixX points, optimization::TargetShape &target, real h) {
 	Ruffle res;
 	res.h = h;
+	SimulationMesh::Builder builder(res.simulation_mesh);
 	int n = points.rows(); 
 	bool closed = points.bottomRows<1>() == points.topRows<1>();
 	constexpr real height_width_ratio = 0.5;
@@ -948,6 +965,7 @@ Ruffle Ruffle::create_stack_along_curve(MatrixX points, optimization::TargetShap
 		prev_normal = normal;
 	}
 
+	builder.finish();
 	res.create_connection_bends();
 	res.update_simulation_mesh();
 
@@ -988,7 +1006,14 @@ void Ruffle::verify() {
 }
 
 
-void Ruffle::physics_solve() {
+void Ruffle::cleanup_simulation_mesh() {
+	vector<int> new_index = simulation_mesh.cleanup();
+	if (simulator) {
+		simulator->remap(new_index);
+	}
+}
+
+void Ruffle::physics_solve(bool warm_start) {
 	if (simulator == nullptr) {
 		cerr << "No simulator set!" << endl;
 		return;
@@ -996,30 +1021,42 @@ void Ruffle::physics_solve() {
 
 	auto start = std::chrono::steady_clock::now();
 
-	simulator->reset(simulation_mesh);
+	if (warm_start) {
+		simulator->warm_start(simulation_mesh);
+	} else {
+		simulator->reset(simulation_mesh);
+	}
 	simulation_mesh.relax_air_mesh();
 
 	int steps = 1;
-	for(; steps < 1000 && !simulator->step(simulation_mesh); steps++) {
+	int max_steps = simulator->max_steps();
+	bool converged = false;
+	for(; steps < max_steps && !(converged = simulator->step(simulation_mesh)); steps++) {
 		//simulation_mesh.relax_air_mesh();
 	}
-	cerr << "Converged? in " << steps << " steps" << endl;
+	cerr << (converged ? "Converged in " : "Not converged after ") << steps << " steps" << endl;
 
 	auto end = std::chrono::steady_clock::now();
 	real elapsed = std::chrono::duration_cast<std::chrono::duration<real>>(end-start).count();
 
 	last_physics_solve_time = elapsed;
+	last_physics_solve_steps = steps;
+	last_physics_solve_converged = converged;
 	physics_solve_total_time += elapsed;
 	physics_solve_count += 1;
 }
 
 
 void Ruffle::Serialize(std::vector<char> &buffer) const {
-
+	format::write(*this, buffer);
 }
 
 void Ruffle::Deserialize(const std::vector<char> &buffer) {
-
+	// scenes saved before the format existed store nothing
+	if (buffer.empty()) {
+		return;
+	}
+	format::read(buffer.data(), buffer.size(), *this);
 }
 
 std::ostream &operator<<(std::ostream &os, const Ruffle::ConnectionPoint &point) {
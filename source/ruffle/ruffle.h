@@ -77,10 +77,10 @@ public:
 	simulation::SimulationMesh simulation_mesh;
 	std::unique_ptr<simulation::Simulator> simulator;
 
-	list<ConnectionPoint> connection_points;
-	list<Section> sections;
+	Arena<ConnectionPoint> connection_points;
+	Arena<Section> sections;
 
-	list<OutlineSection> outline_sections;
+	Arena<OutlineSection> outline_sections;
 
 	real h;
 
@@ -109,9 +109,15 @@ public:
 	Vector2 get_tangent(ConnectionPoint &p);
 
 	void update_simulation_mesh();
-	void physics_solve();
+	/// cleanup() the simulation mesh and carry the simulator state over to the new numbering
+	void cleanup_simulation_mesh();
+	/// With warm_start the simulator continues from its previous state instead of being reset,
+	/// useful when only the lengths changed slightly since the last solve.
+	void physics_solve(bool warm_start = false);
 
 	real last_physics_solve_time = 0.;
+	int last_physics_solve_steps = 0;
+	bool last_physics_solve_converged = false;
 	real physics_solve_total_time = 0.;
 	int physics_solve_count = 0;
 
@@ -140,7 +146,7 @@ public:
 		Ruffle res;
 		res.simulation_mesh = simulation_mesh.clone(tr);
 		//res.simulator = /// ?;
-		tr.transform(connection_points.begin(), connection_points.end(), res.connection_points, [&](ConnectionPoint x) {
+		tr.transform(connection_points, res.connection_points, [&](ConnectionPoint x) {
 			ConnectionPoint new_point(x.position, tr(x.mesh_vertex));
 			new_point.last_direction = x.last_direction;
 			for (int side = 0; side < 2; side++) {
@@ -148,14 +154,20 @@ public:
 			}
 			return new_point;
 		});
-		std::transform(sections.begin(), sections.end(), std::back_inserter(res.sections), [&](Section x) {
+		tr.transform(sections, res.sections, [&](Section x) {
 			Section new_section(tr(x.start), tr(x.end), x.length);
+			new_section.type = x.type;
 			std::transform(x.mesh_segments.begin(), x.mesh_segments.end(), std::back_inserter(new_section.mesh_segments), tr);
 			return new_section;
 		});
+		for (auto &x : outline_sections) {
+			res.outline_sections.emplace_back(tr(x.section), x.reversed);
+		}
+		res.h = h;
 		return res;
 	}
 
+	/// in the binary format of ruffle/ruffle_format.h
 	virtual void Serialize(std::vector<char> &buffer) const override;
 	virtual void Deserialize(const std::vector<char> &buffer) override;
 };
@@ -0,0 +1,450 @@
+#include "ruffle/ruffle_format.h"
+#include "ruffle/ruffle.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ruffles::format {
+
+using simulation::SimulationMesh;
+
+static_assert(sizeof(Parameters) % 8 == 0 && sizeof(Header) % 8 == 0 && sizeof(BlockRef) == 16);
+static_assert(sizeof(Vertex) == 48 && sizeof(Segment) == 16 && sizeof(Bend) == 8);
+static_assert(sizeof(ExtraMass) == 16 && sizeof(ExternalForce) == 24);
+static_assert(sizeof(ConnectionPoint) == 40 && sizeof(Section) == 32 && sizeof(OutlineSection) == 8);
+
+namespace {
+
+[[noreturn]] void fail(const string &what) {
+	throw std::runtime_error("Invalid ruffle data: " + what);
+}
+
+/// the records are stored in the host layout, which has to be the little endian one of the format
+void check_host_byte_order() {
+	uint32_t one = 1;
+	unsigned char first;
+	std::memcpy(&first, &one, 1);
+	if (first != 1) {
+		throw std::runtime_error("The ruffle format is little endian, this host is not");
+	}
+}
+
+uint32_t byte_swapped(uint32_t v) {
+	return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+/// position of every element of arena in list order, by slot index
+template<typename T>
+vector<int32_t> dense_indices(const Arena<T> &arena) {
+	int slots = 0;
+	for (auto it = arena.begin(); it != arena.end(); ++it) {
+		slots = std::max(slots, it.index()+1);
+	}
+	vector<int32_t> res(slots, -1);
+	int32_t i = 0;
+	for (auto it = arena.begin(); it != arena.end(); ++it) {
+		res[it.index()] = i++;
+	}
+	return res;
+}
+
+struct Writer {
+	vector<char> &buffer;
+	size_t start;
+	BlockRef blocks[BlockCount] = {};
+
+	template<typename T>
+	void block(Block b, const vector<T> &records) {
+		blocks[b] = {buffer.size() - start, records.size()};
+		const char *bytes = reinterpret_cast<const char *>(records.data());
+		buffer.insert(buffer.end(), bytes, bytes + records.size()*sizeof(T));
+		// keep the next block aligned
+		buffer.resize(start + (buffer.size() - start + 7) / 8 * 8, 0);
+	}
+};
+
+template<typename T>
+struct View {
+	const T *data = nullptr;
+	int32_t size = 0;
+
+	const T &operator[](int32_t i) const {
+		return data[i];
+	}
+	/// check that [range.begin, range.begin+range.count) lies in this block
+	void check(Range range, const char *what) const {
+		if (range.begin < 0 || range.count < 0 || range.begin > size - range.count) {
+			fail(string("range of ") + what);
+		}
+	}
+	void check(int32_t i, const char *what) const {
+		if (i < 0 || i >= size) {
+			fail(string("index of ") + what);
+		}
+	}
+};
+
+template<typename T>
+View<T> view(const char *data, const Header &header, const BlockRef *blocks, Block b) {
+	if (b >= header.block_count) {
+		return {};
+	}
+	const BlockRef &ref = blocks[b];
+	if (ref.offset % 8 != 0 || ref.offset > header.size || ref.count > (header.size - ref.offset) / sizeof(T) || ref.count > INT32_MAX) {
+		fail("block " + to_string(b));
+	}
+	return {reinterpret_cast<const T *>(data + ref.offset), (int32_t)ref.count};
+}
+
+}
+
+void write(const Ruffle &ruffle, vector<char> &buffer) {
+	check_host_byte_order();
+	const SimulationMesh &mesh = ruffle.simulation_mesh;
+	vector<int32_t> vertex_index = dense_indices(mesh.vertices);
+	vector<int32_t> segment_index = dense_indices(mesh.segments);
+	vector<int32_t> point_index = dense_indices(ruffle.connection_points);
+	vector<int32_t> section_index = dense_indices(ruffle.sections);
+
+	vector<double> z;
+	vector<Vertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for (auto &v : mesh.vertices) {
+		Vertex record = {};
+		if (const Vector2 *position = std::get_if<Vector2>(&v)) {
+			record.position[0] = position->x();
+			record.position[1] = position->y();
+			record.index = -1;
+		} else {
+			record.index = std::get<int>(v);
+		}
+		record.width = v.width;
+		record.mass = v.mass;
+		record.z = {(int32_t)z.size(), (int32_t)v.z.size()};
+		z.insert(z.end(), v.z.begin(), v.z.end());
+		vertices.push_back(record);
+	}
+
+	vector<Segment> segments;
+	segments.reserve(mesh.segments.size());
+	for (auto &seg : mesh.segments) {
+		segments.push_back({vertex_index[seg.start.index()], vertex_index[seg.end.index()], seg.length});
+	}
+
+	vector<Bend> bends;
+	for (auto &[a, b] : mesh.connection_bends) {
+		bends.push_back({{segment_index[a.index()], segment_index[b.index()]}});
+	}
+	vector<ExtraMass> extra_masses;
+	for (auto &[v, mass] : mesh.extra_mass) {
+		extra_masses.push_back({vertex_index[v.index()], 0, mass});
+	}
+	vector<ExternalForce> external_forces;
+	for (auto &[v, force] : mesh.external_forces) {
+		external_forces.push_back({vertex_index[v.index()], 0, {force.x(), force.y()}});
+	}
+
+	vector<int32_t> connecting_segments;
+	vector<ConnectionPoint> points;
+	points.reserve(ruffle.connection_points.size());
+	for (auto &p : ruffle.connection_points) {
+		ConnectionPoint record = {};
+		record.position[0] = p.position.x();
+		record.position[1] = p.position.y();
+		record.mesh_vertex = vertex_index[p.mesh_vertex.index()];
+		record.last_direction = p.last_direction;
+		for (int side = 0; side < 2; side++) {
+			record.connecting_segments[side] = {(int32_t)connecting_segments.size(), (int32_t)p.connecting_segments[side].size()};
+			for (auto seg : p.connecting_segments[side]) {
+				connecting_segments.push_back(segment_index[seg.index()]);
+			}
+		}
+		points.push_back(record);
+	}
+
+	vector<int32_t> section_segments;
+	vector<Section> sections;
+	sections.reserve(ruffle.sections.size());
+	for (auto &section : ruffle.sections) {
+		Section record = {};
+		record.start = point_index[section.start.index()];
+		record.end = point_index[section.end.index()];
+		record.length = section.length;
+		record.type = (int32_t)section.type;
+		record.mesh_segments = {(int32_t)section_segments.size(), (int32_t)section.mesh_segments.size()};
+		for (auto seg : section.mesh_segments) {
+			section_segments.push_back(segment_index[seg.index()]);
+		}
+		sections.push_back(record);
+	}
+
+	vector<OutlineSection> outline;
+	for (auto &o : ruffle.outline_sections) {
+		outline.push_back({section_index[o.section.index()], o.reversed});
+	}
+
+	Header header = {};
+	header.magic = magic;
+	header.version = version;
+	header.block_count = BlockCount;
+	Parameters &parameters = header.parameters;
+	parameters.h = ruffle.h;
+	parameters.k_global = mesh.k_global;
+	parameters.k_bend = mesh.k_bend;
+	parameters.density = mesh.density;
+	parameters.lambda_membrane = mesh.lambda_membrane;
+	parameters.lambda_air_mesh = mesh.lambda_air_mesh;
+	parameters.air_mesh_barrier = mesh.air_mesh_barrier;
+	for (int i = 0; i < 2; i++) {
+		parameters.gravity[i] = mesh.gravity(i);
+		parameters.lb[i] = mesh.lb(i);
+		parameters.ub[i] = mesh.ub(i);
+	}
+
+	Writer writer{buffer, buffer.size()};
+	buffer.resize(writer.start + sizeof(Header) + sizeof(BlockRef)*BlockCount);
+	writer.block(Vertices, vertices);
+	writer.block(Segments, segments);
+	writer.block(Bends, bends);
+	writer.block(ExtraMasses, extra_masses);
+	writer.block(ExternalForces, external_forces);
+	writer.block(ConnectionPoints, points);
+	writer.block(Sections, sections);
+	writer.block(Outline, outline);
+	writer.block(X, vector<double>(mesh.x.data(), mesh.x.data() + mesh.x.size()));
+	writer.block(M, vector<double>(mesh.m.data(), mesh.m.data() + mesh.m.size()));
+	writer.block(Z, z);
+	writer.block(SectionSegments, section_segments);
+	writer.block(ConnectingSegments, connecting_segments);
+
+	header.size = buffer.size() - writer.start;
+	std::memcpy(buffer.data() + writer.start, &header, sizeof(Header));
+	std::memcpy(buffer.data() + writer.start + sizeof(Header), writer.blocks, sizeof(writer.blocks));
+}
+
+void read(const char *data, size_t size, Ruffle &ruffle) {
+	check_host_byte_order();
+	// the records are read in place, which needs aligned data
+	vector<uint64_t> aligned;
+	if (reinterpret_cast<uintptr_t>(data) % 8 != 0) {
+		aligned.resize((size + 7) / 8);
+		std::memcpy(aligned.data(), data, size);
+		data = reinterpret_cast<const char *>(aligned.data());
+	}
+
+	if (size < sizeof(Header)) {
+		fail("truncated header");
+	}
+	const Header &header = *reinterpret_cast<const Header *>(data);
+	if (header.magic == byte_swapped(magic)) {
+		fail("big endian byte order");
+	}
+	if (header.magic != magic) {
+		fail("wrong magic number");
+	}
+	if (header.version > version) {
+		fail("version " + to_string(header.version) + " is newer than " + to_string(version));
+	}
+	if (header.size > size || sizeof(Header) + uint64_t(header.block_count) * sizeof(BlockRef) > header.size) {
+		fail("truncated data");
+	}
+	const BlockRef *blocks = reinterpret_cast<const BlockRef *>(data + sizeof(Header));
+
+	auto vertices = view<Vertex>(data, header, blocks, Vertices);
+	auto segments = view<Segment>(data, header, blocks, Segments);
+	auto bends = view<Bend>(data, header, blocks, Bends);
+	auto extra_masses = view<ExtraMass>(data, header, blocks, ExtraMasses);
+	auto external_forces = view<ExternalForce>(data, header, blocks, ExternalForces);
+	auto points = view<ConnectionPoint>(data, header, blocks, ConnectionPoints);
+	auto sections = view<Section>(data, header, blocks, Sections);
+	auto outline = view<OutlineSection>(data, header, blocks, Outline);
+	auto x = view<double>(data, header, blocks, X);
+	auto m = view<double>(data, header, blocks, M);
+	auto z = view<double>(data, header, blocks, Z);
+	auto section_segments = view<int32_t>(data, header, blocks, SectionSegments);
+	auto connecting_segments = view<int32_t>(data, header, blocks, ConnectingSegments);
+
+	if (x.size % 2 != 0 || m.size != x.size) {
+		fail("size of x or m");
+	}
+
+	// build everything aside, ruffle stays untouched if the data is malformed
+	Ruffle res;
+	SimulationMesh &mesh = res.simulation_mesh;
+	const Parameters &parameters = header.parameters;
+	res.h = parameters.h;
+	mesh.k_global = parameters.k_global;
+	mesh.k_bend = parameters.k_bend;
+	mesh.density = parameters.density;
+	mesh.lambda_membrane = parameters.lambda_membrane;
+	mesh.lambda_air_mesh = parameters.lambda_air_mesh;
+	mesh.air_mesh_barrier = parameters.air_mesh_barrier;
+	mesh.gravity = Vector2(parameters.gravity[0], parameters.gravity[1]);
+	mesh.lb = Vector2(parameters.lb[0], parameters.lb[1]);
+	mesh.ub = Vector2(parameters.ub[0], parameters.ub[1]);
+	mesh.x = Eigen::Map<const VectorX>(x.data, x.size);
+	mesh.m = Eigen::Map<const VectorX>(m.data, m.size);
+
+	vector<listref<SimulationMesh::Vertex>> vertex_refs(vertices.size);
+	mesh.vertices.reserve(vertices.size);
+	for (int32_t i = 0; i < vertices.size; i++) {
+		const Vertex &record = vertices[i];
+		if (record.index >= x.size/2) {
+			fail("index of vertex " + to_string(i));
+		}
+		vertex_refs[i] = record.index < 0 ?
+			mesh.vertices.insert(mesh.vertices.end(), SimulationMesh::Vertex(Vector2(record.position[0], record.position[1]))) :
+			mesh.vertices.insert(mesh.vertices.end(), SimulationMesh::Vertex((int)record.index));
+		vertex_refs[i]->width = record.width;
+		vertex_refs[i]->mass = record.mass;
+		z.check(record.z, "vertex z");
+		vertex_refs[i]->z.assign(z.data + record.z.begin, z.data + record.z.begin + record.z.count);
+	}
+
+	vector<listref<SimulationMesh::Segment>> segment_refs(segments.size);
+	mesh.segments.reserve(segments.size);
+	for (int32_t i = 0; i < segments.size; i++) {
+		const Segment &record = segments[i];
+		vertices.check(record.start, "segment start");
+		vertices.check(record.end, "segment end");
+		segment_refs[i] = mesh.segments.insert(mesh.segments.end(),
+			SimulationMesh::Segment(vertex_refs[record.start], vertex_refs[record.end], record.length));
+	}
+
+	mesh.connection_bends.reserve(bends.size);
+	for (int32_t i = 0; i < bends.size; i++) {
+		segments.check(bends[i].segments[0], "bend");
+		segments.check(bends[i].segments[1], "bend");
+		mesh.connection_bends.push_back({segment_refs[bends[i].segments[0]], segment_refs[bends[i].segments[1]]});
+	}
+	mesh.extra_mass.reserve(extra_masses.size);
+	for (int32_t i = 0; i < extra_masses.size; i++) {
+		vertices.check(extra_masses[i].vertex, "extra mass");
+		mesh.extra_mass.emplace_back(vertex_refs[extra_masses[i].vertex], extra_masses[i].mass);
+	}
+	mesh.external_forces.reserve(external_forces.size);
+	for (int32_t i = 0; i < external_forces.size; i++) {
+		const ExternalForce &record = external_forces[i];
+		vertices.check(record.vertex, "external force");
+		mesh.external_forces.emplace_back(vertex_refs[record.vertex], Vector2(record.force[0], record.force[1]));
+	}
+
+	vector<listref<Ruffle::ConnectionPoint>> point_refs(points.size);
+	res.connection_points.reserve(points.size);
+	for (int32_t i = 0; i < points.size; i++) {
+		const ConnectionPoint &record = points[i];
+		vertices.check(record.mesh_vertex, "connection point");
+		point_refs[i] = res.connection_points.insert(res.connection_points.end(),
+			Ruffle::ConnectionPoint(Vector2(record.position[0], record.position[1]), vertex_refs[record.mesh_vertex]));
+		point_refs[i]->last_direction = record.last_direction;
+		for (int side = 0; side < 2; side++) {
+			Range range = record.connecting_segments[side];
+			connecting_segments.check(range, "connecting segments");
+			point_refs[i]->connecting_segments[side].reserve(range.count);
+			for (int32_t j = range.begin; j < range.begin + range.count; j++) {
+				segments.check(connecting_segments[j], "connecting segment");
+				point_refs[i]->connecting_segments[side].push_back(segment_refs[connecting_segments[j]]);
+			}
+		}
+	}
+
+	vector<listref<Ruffle::Section>> section_refs(sections.size);
+	res.sections.reserve(sections.size);
+	for (int32_t i = 0; i < sections.size; i++) {
+		const Section &record = sections[i];
+		points.check(record.start, "section start");
+		points.check(record.end, "section end");
+		if (record.type < 0 || record.type > (int32_t)Ruffle::Section::Type::DensifiedCurved) {
+			fail("type of section " + to_string(i));
+		}
+		section_refs[i] = res.sections.insert(res.sections.end(),
+			Ruffle::Section(point_refs[record.start], point_refs[record.end], record.length));
+		section_refs[i]->type = (Ruffle::Section::Type)record.type;
+		section_segments.check(record.mesh_segments, "section segments");
+		section_refs[i]->mesh_segments.reserve(record.mesh_segments.count);
+		for (int32_t j = record.mesh_segments.begin; j < record.mesh_segments.begin + record.mesh_segments.count; j++) {
+			segments.check(section_segments[j], "section segment");
+			section_refs[i]->mesh_segments.push_back(segment_refs[section_segments[j]]);
+		}
+	}
+
+	res.outline_sections.reserve(outline.size);
+	for (int32_t i = 0; i < outline.size; i++) {
+		sections.check(outline[i].section, "outline");
+		res.outline_sections.emplace_back(section_refs[outline[i].section], outline[i].reversed != 0);
+	}
+
+	ruffle.simulation_mesh = std::move(res.simulation_mesh);
+	ruffle.connection_points = std::move(res.connection_points);
+	ruffle.sections = std::move(res.sections);
+	ruffle.outline_sections = std::move(res.outline_sections);
+	ruffle.h = res.h;
+	if (ruffle.simulator) {
+		ruffle.simulator->reset(ruffle.simulation_mesh);
+	}
+}
+
+void write_file(const string &path, const Ruffle &ruffle) {
+	vector<char> buffer;
+	write(ruffle, buffer);
+	std::ofstream out(path, std::ios::binary);
+	out.write(buffer.data(), buffer.size());
+	if (!out) {
+		throw std::runtime_error("Could not write " + path);
+	}
+}
+
+void read_file(const string &path, Ruffle &ruffle) {
+#ifdef _WIN32
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		throw std::runtime_error("Could not open " + path);
+	}
+	vector<char> buffer((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	read(buffer.data(), buffer.size(), ruffle);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Could not open " + path);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not open " + path);
+	}
+	size_t size = st.st_size;
+	if (size == 0) {
+		// mmap can't map nothing, read() rejects it with the usual message
+		close(fd);
+		read(nullptr, 0, ruffle);
+		return;
+	}
+	// page aligned, so read() uses the records where they are
+	void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		throw std::runtime_error("Could not map " + path);
+	}
+	// unmap also if read() throws
+	struct Unmap {
+		void *data;
+		size_t size;
+		~Unmap() {
+			munmap(data, size);
+		}
+	} unmap{data, size};
+	read(static_cast<const char *>(data), size, ruffle);
+#endif
+}
+
+}
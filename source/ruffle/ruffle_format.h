@@ -0,0 +1,138 @@
+#pragma once
+
+#include "common/common.h"
+
+#include <cstdint>
+
+namespace ruffles {
+class Ruffle;
+}
+
+/// Compact binary format of a Ruffle: a header, a table of blocks and one flat array of fixed size
+/// records per block. References between elements are indices into the arrays, so read() validates
+/// and converts the records where they are, e.g. in a memory mapped file, without a parsing step or a
+/// copy of aligned data. The Ruffle it builds still allocates its arena nodes and per element vectors.
+/// All records are little endian, written in the host layout: write() and read() throw on big endian
+/// hosts and read() rejects byte swapped data. Records are 8 byte aligned. Newer versions only append
+/// blocks, so readers treat blocks missing in older data as empty; data of newer versions is rejected.
+namespace ruffles::format {
+
+constexpr uint32_t magic = 0x4c465552; // "RUFL"
+constexpr uint32_t version = 1;
+
+enum Block : uint32_t {
+	Vertices,
+	Segments,
+	Bends,
+	ExtraMasses,
+	ExternalForces,
+	ConnectionPoints,
+	Sections,
+	Outline,
+	X,
+	M,
+	Z,                  // z values of all vertices
+	SectionSegments,    // mesh segments of all sections
+	ConnectingSegments, // connecting segments of all connection points
+	BlockCount
+};
+
+/// solver parameters of the simulation mesh and the ruffle
+struct Parameters {
+	double h;
+	double k_global;
+	double k_bend;
+	double density;
+	double lambda_membrane;
+	double lambda_air_mesh;
+	double gravity[2];
+	double lb[2];
+	double ub[2];
+	int32_t air_mesh_barrier;
+	int32_t pad;
+};
+
+struct Header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;        // of the whole data
+	uint32_t block_count; // entries of the BlockRef table following the header
+	uint32_t pad;
+	Parameters parameters;
+};
+
+struct BlockRef {
+	uint64_t offset; // from the start of the data
+	uint64_t count;
+};
+
+/// range [begin, begin+count) into another block
+struct Range {
+	int32_t begin;
+	int32_t count;
+};
+
+struct Vertex {
+	double position[2]; // fixed vertices only
+	double width;
+	double mass;
+	int32_t index;      // into x, -1 for fixed vertices
+	int32_t pad;
+	Range z;
+};
+
+struct Segment {
+	int32_t start;
+	int32_t end;
+	double length;
+};
+
+struct Bend {
+	int32_t segments[2];
+};
+
+struct ExtraMass {
+	int32_t vertex;
+	int32_t pad;
+	double mass;
+};
+
+struct ExternalForce {
+	int32_t vertex;
+	int32_t pad;
+	double force[2];
+};
+
+struct ConnectionPoint {
+	double position[2];
+	int32_t mesh_vertex;
+	int32_t last_direction;
+	Range connecting_segments[2];
+};
+
+struct Section {
+	int32_t start;
+	int32_t end;
+	double length;
+	int32_t type;
+	int32_t pad;
+	Range mesh_segments;
+};
+
+struct OutlineSection {
+	int32_t section;
+	int32_t reversed;
+};
+
+/// append ruffle to buffer, the simulator and air mesh are not stored
+void write(const Ruffle &ruffle, std::vector<char> &buffer);
+/// replace the contents of ruffle by the data written by write(),
+/// throws std::runtime_error if the data is malformed
+void read(const char *data, size_t size, Ruffle &ruffle);
+
+/// write() into a new file at path, throws std::runtime_error if it can't be written
+void write_file(const string &path, const Ruffle &ruffle);
+/// read() from the file at path, memory mapped where available instead of copied into a buffer
+void read_file(const string &path, Ruffle &ruffle);
+
+}
@@ -1,9 +1,8 @@
 #include "simulation/air_mesh.h"
 #include "simulation/simulation_mesh.h"
-#include <unordered_map>
+#include "common/thread_pool.h"
 
-// for listref_hash<T>
-#include "common/clone_helper.h"
+#include <igl/parallel_for.h>
 
 namespace ruffles::simulation {
 
@@ -11,40 +10,98 @@ AirMesh::AirMesh() {
 }
 
 AirMesh::AirMesh(SimulationMesh &mesh) {
-	vector<CDT::Vertex_handle> cdt_vertices;
-	std::unordered_map<listref<SimulationMesh::Vertex>, int, listref_hash<SimulationMesh::Vertex>> indices;
-
 	int i = 0;
 	for (auto it = mesh.vertices.begin(); it != mesh.vertices.end(); ++it) {
 		Vector2 x = mesh.get_vertex_position(*it);
-		CDT::Vertex_handle vh = cdt.insert(Point(x(0), x(1)));
+		CDT::Vertex_handle vh = cdt.insert(CDT::Point(x(0), x(1)));
 		vh->info() = i;
-		cdt_vertices.push_back(vh);
+		handles.push_back(vh);
 		vertices.push_back(static_cast<std::variant<Vector2,int>>(*it));
 
-		indices.insert({it, i});
+		vertex_indices.insert({&*it, i});
 
 		i++;
 	}
 	for (auto seg : mesh.segments) {
-		CDT::Vertex_handle a = cdt_vertices[indices[seg.start]];
-		CDT::Vertex_handle b = cdt_vertices[indices[seg.end]];
+		CDT::Vertex_handle a = handles[vertex_indices[&*seg.start]];
+		CDT::Vertex_handle b = handles[vertex_indices[&*seg.end]];
 		cdt.insert_constraint(a, b);
 	}
 
 	relax(mesh.x);
+	update_faces();
 }
 
 
 void AirMesh::clear() {
 	cdt.clear();
 	vertices.clear();
+	faces.clear();
+	inverted.clear();
+	relaxed_positions.clear();
+	handles.clear();
+	vertex_indices.clear();
 }
 
 bool AirMesh::empty() const {
 	return cdt.number_of_faces() == 0;
 }
 
+void AirMesh::update_faces() {
+	faces.clear();
+	inverted.clear();
+	faces.reserve(cdt.number_of_faces());
+	for (auto face = cdt.finite_faces_begin(); face != cdt.finite_faces_end(); ++face) {
+		faces.push_back({
+			face->vertex(0)->info(),
+			face->vertex(1)->info(),
+			face->vertex(2)->info()});
+	}
+}
+
+bool AirMesh::split_constraint(const std::variant<Vector2, int> *a, const std::variant<Vector2, int> *b,
+	const std::variant<Vector2, int> *center, Vector2 position) {
+	auto ia = vertex_indices.find(a);
+	auto ib = vertex_indices.find(b);
+	if (ia == vertex_indices.end() || ib == vertex_indices.end()) {
+		return false;
+	}
+	CDT::Vertex_handle va = handles[ia->second];
+	CDT::Vertex_handle vb = handles[ib->second];
+
+	CDT::Face_handle f;
+	int i;
+	if (!cdt.is_edge(va, vb, f, i)) {
+		return false;
+	}
+
+	auto mark_constrained = [this](CDT::Face_handle f, int i, bool constrained) {
+		f->set_constraint(i, constrained);
+		f->neighbor(i)->set_constraint(cdt.mirror_index(f,i), constrained);
+	};
+
+	mark_constrained(f, i, false);
+	CDT::Vertex_handle vc = cdt.tds().insert_in_edge(f, i);
+	vc->set_point(CDT::Point(position.x(), position.y()));
+	vc->info() = vertices.size();
+	vertices.push_back(*center);
+	handles.push_back(vc);
+	vertex_indices.insert({center, vc->info()});
+
+	// constrain the two halves a-center and center-b
+	auto c = vc->incident_edges(), done = c;
+	do {
+		CDT::Vertex_handle u = c->first->vertex((c->second+1)%3);
+		CDT::Vertex_handle w = c->first->vertex((c->second+2)%3);
+		CDT::Vertex_handle other = u == vc ? w : u;
+		if (other == va || other == vb) {
+			mark_constrained(c->first, c->second, true);
+		}
+	} while (++c != done);
+
+	update_faces();
+	return true;
+}
 
 bool AirMesh::relax(const VectorX &x) {
 	auto get_vertex_position = [&](int ix) -> Vector2 {
@@ -80,36 +137,81 @@ bool AirMesh::relax(const VectorX &x) {
 		return area / (ab.squaredNorm() + ac.squaredNorm() + bc.squaredNorm());
 	};
 
+	// existing faces keep their cached quality as long as none of their vertices moved
+	auto vertex_id = [&](CDT::Vertex_handle v) {
+		return cdt.is_infinite(v) ? -1 : v->info();
+	};
+	auto face_quality = [&](CDT::Face_handle f) -> real {
+		array<int, 3> ids = {vertex_id(f->vertex(0)), vertex_id(f->vertex(1)), vertex_id(f->vertex(2))};
+		if (f->info().vertices != ids) {
+			f->info().vertices = ids;
+			f->info().quality = quality(f->vertex(0), f->vertex(1), f->vertex(2));
+		}
+		return f->info().quality;
+	};
+
+	// worklist of edges as vertex pairs, the faces of an edge change when it is flipped
+	vector<pair<CDT::Vertex_handle, CDT::Vertex_handle>> queue;
+	auto push_edges = [&](CDT::Face_handle f) {
+		for (int i = 0; i < 3; i++) {
+			queue.emplace_back(f->vertex((i+1)%3), f->vertex((i+2)%3));
+		}
+	};
+
+	relaxed_positions.resize(vertices.size(), Vector2::Constant(std::nan("")));
+	for (auto v = cdt.finite_vertices_begin(); v != cdt.finite_vertices_end(); ++v) {
+		Vector2 pos = get_vertex_position(v->info());
+		Vector2 &relaxed = relaxed_positions[v->info()];
+		if (!((pos - relaxed).norm() <= relax_tolerance)) {
+			relaxed = pos;
+			auto f = v->incident_faces(), done = f;
+			do {
+				f->info().vertices = {-1, -1, -1};
+				push_edges(f);
+			} while (++f != done);
+		}
+	}
+
 	bool any_flips = false;
-	bool has_flips;
-	do {
-		has_flips = false;
-		for (auto edge = cdt.edges_begin(); edge != cdt.edges_end(); ++edge) {
-			if (cdt.is_constrained(*edge)) {
-				// don't flip constrained edges
-				continue;
-			}
-			auto f1 = edge->first;
-			auto f2 = f1->neighbor(edge->second);
-
-			bool flip = false;
-			auto a = f1->vertex(edge->second);
-			auto b = f1->vertex((edge->second+1)%3);
-			auto c = f1->vertex((edge->second+2)%3);
-			auto d = f2->vertex(f2->index(f1));
-
-			real old_quality = min(quality(a,b,c), quality(b,d,c));
-			real new_quality = min(quality(a,b,d), quality(a,d,c));
-
-			flip = std::isfinite(old_quality) ? new_quality > old_quality : false;
-			if (flip) {
-				cdt.flip(f1, edge->second);
-				has_flips = true;
-				any_flips = true;
-			}
+	while (!queue.empty()) {
+		auto [vb, vc] = queue.back();
+		queue.pop_back();
+
+		CDT::Face_handle f1;
+		int i;
+		if (cdt.is_infinite(vb) || cdt.is_infinite(vc) || !cdt.is_edge(vb, vc, f1, i)) {
+			// only finite edges are flipped, the edge may also have been flipped away already
+			continue;
 		}
-	} while (has_flips);
+		if (cdt.is_constrained(CDT::Edge(f1, i))) {
+			// don't flip constrained edges
+			continue;
+		}
+		auto f2 = f1->neighbor(i);
+
+		auto a = f1->vertex(i);
+		auto b = f1->vertex((i+1)%3);
+		auto c = f1->vertex((i+2)%3);
+		auto d = f2->vertex(f2->index(f1));
+
+		real old_quality = min(face_quality(f1), face_quality(f2));
+		real new_quality = min(quality(a,b,d), quality(a,d,c));
+
+		bool flip = std::isfinite(old_quality) ? new_quality > old_quality : false;
+		if (flip) {
+			cdt.flip(f1, i);
+			any_flips = true;
+			// the two faces now share the edge a-d, recheck the outer edges of the quad
+			f1->info().vertices = {-1, -1, -1};
+			f2->info().vertices = {-1, -1, -1};
+			push_edges(f1);
+			push_edges(f2);
+		}
+	}
 
+	if (any_flips) {
+		update_faces();
+	}
 	return any_flips;
 }
 
@@ -124,30 +226,39 @@ real AirMesh::penalty(real k, const VectorX &x, VectorX *grad) const {
 		}
 		return res;
 	};
-	real res = 0;
-	for (auto face = cdt.finite_faces_begin(); face != cdt.finite_faces_end(); ++face) {
-		Vector2 a = get_vertex_position(face->vertex(0)->info());
-		Vector2 b = get_vertex_position(face->vertex(1)->info());
-		Vector2 c = get_vertex_position(face->vertex(2)->info());
+
+	// areas in parallel, only the few inverted faces contribute afterwards
+	VectorX areas(faces.size());
+	igl::parallel_for((int)faces.size(), [&](int i) {
+		Vector2 a = get_vertex_position(faces[i][0]);
+		Vector2 b = get_vertex_position(faces[i][1]);
+		Vector2 c = get_vertex_position(faces[i][2]);
 
 		auto ab = b-a;
 		auto ac = c-a;
-		auto bc = c-b;
-		real area = ab.x() * ac.y() - ab.y() * ac.x();
+		areas(i) = ab.x() * ac.y() - ab.y() * ac.x();
+	}, parallel_threshold(1000));
 
-		//real circumference = ab.norm() + ac.norm() + bc.norm();
-
-		real penalty;
+	real res = 0;
+	for (int i = 0; i < (int)faces.size(); i++) {
+		real area = areas(i);
 		if (area >= 0) {
-			penalty = 0;
-		} else {
-			// TODO: divide by circumference for multiresolution?
-			penalty = -area ; // /circumference;
+			continue;
 		}
 
+		// TODO: divide by circumference for multiresolution?
+		real penalty = -area;
 		res += k * penalty;
 
 		if (grad) {
+			Vector2 a = get_vertex_position(faces[i][0]);
+			Vector2 b = get_vertex_position(faces[i][1]);
+			Vector2 c = get_vertex_position(faces[i][2]);
+
+			auto ab = b-a;
+			auto ac = c-a;
+			auto bc = c-b;
+
 			Vector2 darea_da(-bc.y(),  bc.x());
 			Vector2 darea_db( ac.y(), -ac.x());
 			Vector2 darea_dc(-ab.y(),  ab.x());
@@ -155,32 +266,351 @@ real AirMesh::penalty(real k, const VectorX &x, VectorX *grad) const {
 			Vector2 dpenalty_da = -darea_da;
 			Vector2 dpenalty_db = -darea_db;
 			Vector2 dpenalty_dc = -darea_dc;
-			real fac; // dW/dpenalty
-			fac = k;
-			if (area >= 0) {
-				fac = 0;
-			} else {
-			}
-			if (const int *ix = get_if<int>(&vertices[face->vertex(0)->info()])) {
+			real fac = k; // dW/dpenalty
+			if (const int *ix = get_if<int>(&vertices[faces[i][0]])) {
 				grad->segment<2>(2**ix) += fac * dpenalty_da;
 			}
-			if (const int *ix = get_if<int>(&vertices[face->vertex(1)->info()])) {
+			if (const int *ix = get_if<int>(&vertices[faces[i][1]])) {
 				grad->segment<2>(2**ix) += fac * dpenalty_db;
 			}
-			if (const int *ix = get_if<int>(&vertices[face->vertex(2)->info()])) {
+			if (const int *ix = get_if<int>(&vertices[faces[i][2]])) {
 				grad->segment<2>(2**ix) += fac * dpenalty_dc;
 			}
 		}
 	}
 	return res;
 }
+void AirMesh::penalty_hessian(real k, const VectorX &x, vector<Eigen::Triplet<real>> &triplets, bool project) const {
+	auto get_vertex_position = [&](int ix) -> Vector2 {
+		Vector2 res;
+		if (auto fixed = get_if<Vector2>(&vertices[ix])) {
+			res = *fixed;
+		}
+		if (auto index = get_if<int>(&vertices[ix])) {
+			res = x.segment<2>(2**index);
+		}
+		return res;
+	};
+
+	// area = a x b + b x c + c x a is bilinear, so the hessian is constant
+	Matrix2 r;
+	r << 0., 1.,
+	    -1., 0.;
+	Matrix2 z = Matrix2::Zero();
+	Matrix6 hess_area;
+	hess_area <<
+		 z,             r, r.transpose(),
+		 r.transpose(), z, r,
+		 r, r.transpose(), z;
+	Matrix6 hess = -k * hess_area;
+	if (project) {
+		hess = project_positive_definite<6>(hess);
+	}
+
+	for (auto &face : faces) {
+		Vector2 a = get_vertex_position(face[0]);
+		Vector2 b = get_vertex_position(face[1]);
+		Vector2 c = get_vertex_position(face[2]);
+
+		auto ab = b-a;
+		auto ac = c-a;
+		real area = ab.x() * ac.y() - ab.y() * ac.x();
+
+		// faces that are not inverted add zeros, which keeps the sparsity pattern fixed
+		real fac = area < 0 ? 1. : 0.;
+
+		for (int i = 0; i < 3; i++) {
+			const int *ix = get_if<int>(&vertices[face[i]]);
+			if (!ix) continue;
+			for (int j = 0; j < 3; j++) {
+				const int *jx = get_if<int>(&vertices[face[j]]);
+				if (!jx) continue;
+				addHessianBlock(fac * hess.block<2,2>(2*i, 2*j), 2**ix, 2**jx, triplets);
+			}
+		}
+	}
+}
+// log barrier on the doubled area and its first two derivatives, zero above area_hat
+static real barrier_function(real area, real area_hat, real *d1 = nullptr, real *d2 = nullptr) {
+	if (area >= area_hat) {
+		if (d1) *d1 = 0.;
+		if (d2) *d2 = 0.;
+		return 0.;
+	}
+	real d = area - area_hat;
+	real l = std::log(area / area_hat);
+	if (d1) *d1 = -2*d*l - d*d/area;
+	if (d2) *d2 = -2*l - 4*d/area + d*d/(area*area);
+	return -d*d*l;
+}
+
 real AirMesh::barrier(real k, const VectorX &x, VectorX *grad) const {
-	(void)k;
-	(void)x;
-	(void)grad;
-	// TODO
-	return 0.;
+	auto get_vertex_position = [&](int ix) -> Vector2 {
+		Vector2 res;
+		if (auto fixed = get_if<Vector2>(&vertices[ix])) {
+			res = *fixed;
+		}
+		if (auto index = get_if<int>(&vertices[ix])) {
+			res = x.segment<2>(2**index);
+		}
+		return res;
+	};
+
+	VectorX areas(faces.size());
+	igl::parallel_for((int)faces.size(), [&](int i) {
+		Vector2 a = get_vertex_position(faces[i][0]);
+		Vector2 b = get_vertex_position(faces[i][1]);
+		Vector2 c = get_vertex_position(faces[i][2]);
+
+		auto ab = b-a;
+		auto ac = c-a;
+		areas(i) = ab.x() * ac.y() - ab.y() * ac.x();
+	}, parallel_threshold(1000));
+
+	real res = 0;
+	for (int i = 0; i < (int)faces.size(); i++) {
+		real area = areas(i);
+		bool penalty = penalized(i, area);
+		if (area >= (penalty ? 0. : barrier_area)) {
+			continue;
+		}
+		if (area <= 0 && !penalty) {
+			return std::numeric_limits<real>::infinity();
+		}
+
+		// the penalty is linear in the area
+		real dbarrier = -1.;
+		res += k * (penalty ? -area : barrier_function(area, barrier_area, &dbarrier));
+
+		if (grad) {
+			Vector2 a = get_vertex_position(faces[i][0]);
+			Vector2 b = get_vertex_position(faces[i][1]);
+			Vector2 c = get_vertex_position(faces[i][2]);
+
+			auto ab = b-a;
+			auto ac = c-a;
+			auto bc = c-b;
+
+			Vector2 darea_da(-bc.y(),  bc.x());
+			Vector2 darea_db( ac.y(), -ac.x());
+			Vector2 darea_dc(-ab.y(),  ab.x());
+
+			real fac = k * dbarrier;
+			if (const int *ix = get_if<int>(&vertices[faces[i][0]])) {
+				grad->segment<2>(2**ix) += fac * darea_da;
+			}
+			if (const int *ix = get_if<int>(&vertices[faces[i][1]])) {
+				grad->segment<2>(2**ix) += fac * darea_db;
+			}
+			if (const int *ix = get_if<int>(&vertices[faces[i][2]])) {
+				grad->segment<2>(2**ix) += fac * darea_dc;
+			}
+		}
+	}
+	return res;
+}
+
+void AirMesh::barrier_hessian(real k, const VectorX &x, vector<Eigen::Triplet<real>> &triplets, bool project) const {
+	auto get_vertex_position = [&](int ix) -> Vector2 {
+		Vector2 res;
+		if (auto fixed = get_if<Vector2>(&vertices[ix])) {
+			res = *fixed;
+		}
+		if (auto index = get_if<int>(&vertices[ix])) {
+			res = x.segment<2>(2**index);
+		}
+		return res;
+	};
+
+	Matrix2 r;
+	r << 0., 1.,
+	    -1., 0.;
+	Matrix2 z = Matrix2::Zero();
+	Matrix6 hess_area;
+	hess_area <<
+		 z,             r, r.transpose(),
+		 r.transpose(), z, r,
+		 r, r.transpose(), z;
+
+	for (auto &face : faces) {
+		Vector2 a = get_vertex_position(face[0]);
+		Vector2 b = get_vertex_position(face[1]);
+		Vector2 c = get_vertex_position(face[2]);
+
+		auto ab = b-a;
+		auto ac = c-a;
+		auto bc = c-b;
+		real area = ab.x() * ac.y() - ab.y() * ac.x();
+
+		// faces away from contact add zeros, which keeps the sparsity pattern fixed
+		Matrix6 hess = Matrix6::Zero();
+		if (penalized(&face - faces.data(), area)) {
+			if (area < 0) {
+				hess = project ? project_positive_definite<6>(Matrix6(-k * hess_area)) : Matrix6(-k * hess_area);
+			}
+		} else if (area > 0 && area < barrier_area) {
+			Vector6 darea;
+			darea <<
+				-bc.y(),  bc.x(),
+				 ac.y(), -ac.x(),
+				-ab.y(),  ab.x();
+			real d1, d2;
+			barrier_function(area, barrier_area, &d1, &d2);
+			hess = k * (d2 * darea * darea.transpose() + d1 * hess_area);
+			if (project) {
+				hess = project_positive_definite<6>(hess);
+			}
+		}
+
+		for (int i = 0; i < 3; i++) {
+			const int *ix = get_if<int>(&vertices[face[i]]);
+			if (!ix) continue;
+			for (int j = 0; j < 3; j++) {
+				const int *jx = get_if<int>(&vertices[face[j]]);
+				if (!jx) continue;
+				addHessianBlock(hess.block<2,2>(2*i, 2*j), 2**ix, 2**jx, triplets);
+			}
+		}
+	}
 }
+
+void AirMesh::barrier_hessian_diagonal(real k, const VectorX &x, VectorX &diag) const {
+	auto get_vertex_position = [&](int ix) -> Vector2 {
+		Vector2 res;
+		if (auto fixed = get_if<Vector2>(&vertices[ix])) {
+			res = *fixed;
+		}
+		if (auto index = get_if<int>(&vertices[ix])) {
+			res = x.segment<2>(2**index);
+		}
+		return res;
+	};
+
+	// the area hessian has zero diagonal blocks, only d2 * darea darea^T remains
+	for (auto &face : faces) {
+		Vector2 a = get_vertex_position(face[0]);
+		Vector2 b = get_vertex_position(face[1]);
+		Vector2 c = get_vertex_position(face[2]);
+
+		auto ab = b-a;
+		auto ac = c-a;
+		auto bc = c-b;
+		real area = ab.x() * ac.y() - ab.y() * ac.x();
+		if (area <= 0 || area >= barrier_area || penalized(&face - faces.data(), area)) {
+			continue;
+		}
+
+		Vector2 darea[3] = {
+			Vector2(-bc.y(),  bc.x()),
+			Vector2( ac.y(), -ac.x()),
+			Vector2(-ab.y(),  ab.x()),
+		};
+		real d2;
+		barrier_function(area, barrier_area, nullptr, &d2);
+		for (int i = 0; i < 3; i++) {
+			if (const int *ix = get_if<int>(&vertices[face[i]])) {
+				diag.segment<2>(2**ix) += k * max(0., d2) * darea[i].cwiseAbs2();
+			}
+		}
+	}
+}
+
+real AirMesh::max_step(const VectorX &x, const VectorX &dx) const {
+	constexpr real safety = 0.8;
+
+	auto get_vertex_position = [&](const VectorX &x, int ix, bool displacement) -> Vector2 {
+		Vector2 res;
+		if (auto fixed = get_if<Vector2>(&vertices[ix])) {
+			res = displacement ? Vector2::Zero() : *fixed;
+		}
+		if (auto index = get_if<int>(&vertices[ix])) {
+			res = x.segment<2>(2**index);
+		}
+		return res;
+	};
+	auto cross = [](Vector2 u, Vector2 v) {
+		return u.x() * v.y() - u.y() * v.x();
+	};
+
+	// the doubled area along the step is a quadratic c0 + c1 t + c2 t^2, find its first root in [0, 1/safety]
+	VectorX roots(faces.size());
+	igl::parallel_for((int)faces.size(), [&](int i) {
+		Vector2 a = get_vertex_position(x, faces[i][0], false);
+		Vector2 b = get_vertex_position(x, faces[i][1], false);
+		Vector2 c = get_vertex_position(x, faces[i][2], false);
+		Vector2 da = get_vertex_position(dx, faces[i][0], true);
+		Vector2 db = get_vertex_position(dx, faces[i][1], true);
+		Vector2 dc = get_vertex_position(dx, faces[i][2], true);
+
+		Vector2 u = b-a, v = c-a;
+		Vector2 du = db-da, dv = dc-da;
+		real c0 = cross(u, v);
+		real c1 = cross(u, dv) + cross(du, v);
+		real c2 = cross(du, dv);
+
+		real t = infinity;
+		if (penalized(i, c0)) {
+			// may cross zero freely, the penalty is finite
+		} else if (c0 <= 0) {
+			t = 0.;
+		} else if (std::abs(c2) <= 1e-12 * (std::abs(c1) + c0)) {
+			if (c1 < 0) {
+				t = -c0 / c1;
+			}
+		} else {
+			real disc = c1*c1 - 4*c2*c0;
+			if (disc >= 0) {
+				// numerically stable roots
+				real q = -0.5 * (c1 + std::copysign(std::sqrt(disc), c1));
+				for (real root : {q / c2, c0 / q}) {
+					if (root > 0) {
+						t = min(t, root);
+					}
+				}
+			}
+		}
+		roots(i) = t;
+	}, parallel_threshold(1000));
+
+	real t = roots.size() ? roots.minCoeff() : infinity;
+	return min(1., safety * t);
+}
+
+bool AirMesh::update_inverted(const VectorX &x) {
+	auto get_vertex_position = [&](int ix) -> Vector2 {
+		Vector2 res;
+		if (auto fixed = get_if<Vector2>(&vertices[ix])) {
+			res = *fixed;
+		}
+		if (auto index = get_if<int>(&vertices[ix])) {
+			res = x.segment<2>(2**index);
+		}
+		return res;
+	};
+
+	// without flags every face with A <= 0 already counts as flagged, which the first pass reproduces
+	bool changed = false;
+	if (inverted.size() != faces.size()) {
+		inverted.assign(faces.size(), false);
+	}
+	for (int i = 0; i < (int)faces.size(); i++) {
+		Vector2 a = get_vertex_position(faces[i][0]);
+		Vector2 b = get_vertex_position(faces[i][1]);
+		Vector2 c = get_vertex_position(faces[i][2]);
+
+		auto ab = b-a;
+		auto ac = c-a;
+		real area = ab.x() * ac.y() - ab.y() * ac.x();
+
+		bool flag = area <= 0 || (inverted[i] && area < barrier_area);
+		if (flag != (bool)inverted[i]) {
+			inverted[i] = flag;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
 void AirMesh::project(VectorX &x) const {
 	if (empty()) {
 		return;
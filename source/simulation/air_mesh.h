@@ -3,25 +3,43 @@
 #include "common/common.h"
 #include "common/cgal_util.h"
 
+#include <variant>
+#include <unordered_map>
+
 #include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
 #include <CGAL/Constrained_Delaunay_triangulation_2.h>
 
 namespace ruffles::simulation {
 
 class SimulationMesh;
 
+/// quality of a face as cached by AirMesh::relax, valid while the face has the same vertices
+struct AirFaceInfo {
+	array<int, 3> vertices = {-1, -1, -1};
+	real quality = 0.;
+};
+
+// the air mesh only needs predicates, its constraints never intersect
 typedef CGAL::Triangulation_data_structure_2<
-		CGAL::Triangulation_vertex_base_with_info_2<int, K>,
-		CGAL::Constrained_triangulation_face_base_2<K>
+		CGAL::Triangulation_vertex_base_with_info_2<int, AirMeshKernel>,
+		CGAL::Constrained_triangulation_face_base_2<AirMeshKernel,
+			CGAL::Triangulation_face_base_with_info_2<AirFaceInfo, AirMeshKernel>>
 > TriangulationDataStructure;
 
-typedef CGAL::Triangulation_2<K, TriangulationDataStructure> Triangulation;
-typedef CGAL::Constrained_Delaunay_triangulation_2<K,TriangulationDataStructure> CDT;
+typedef CGAL::Triangulation_2<AirMeshKernel, TriangulationDataStructure> Triangulation;
+typedef CGAL::Constrained_Delaunay_triangulation_2<AirMeshKernel,TriangulationDataStructure> CDT;
 
 class AirMesh {
 public:
 	CDT cdt;
 	vector<std::variant<Vector2, int>> vertices;
+	/// cdt vertex of each entry of vertices
+	vector<CDT::Vertex_handle> handles;
+	/// index into vertices of each simulation mesh vertex
+	std::unordered_map<const std::variant<Vector2, int>*, int> vertex_indices;
+	/// finite faces as indices into vertices, refreshed by update_faces() whenever cdt changes
+	vector<array<int, 3>> faces;
 
 	AirMesh();
 	AirMesh(SimulationMesh &mesh);
@@ -29,13 +47,50 @@ public:
 
 	void clear();
 	bool empty() const;
+	void update_faces();
+
+	/// Split the constrained edge a-b by inserting center at position, in O(degree of a).
+	/// Returns false if a-b is not an edge of the air mesh.
+	bool split_constraint(const std::variant<Vector2, int> *a, const std::variant<Vector2, int> *b,
+		const std::variant<Vector2, int> *center, Vector2 position);
 
+	/// Flip edges to improve the worst triangle quality.
+	/// Only edges around vertices that moved by more than relax_tolerance since the last call are
+	/// checked, followed by the edges around every flip, so the cost follows the local change.
 	bool relax(const VectorX &x);
+	real relax_tolerance = 1e-6;
 
 	real penalty(real k, const VectorX &x, VectorX *grad) const;
+	void penalty_hessian(real k, const VectorX &x, vector<Eigen::Triplet<real>> &triplets, bool project = true) const;
+	/// Log barrier -(A-Â)^2 log(A/Â) on the doubled area A of every face with A < Â = barrier_area,
+	/// infinite once a face is inverted. Faces flagged in inverted get penalty() instead.
 	real barrier(real k, const VectorX &x, VectorX *grad) const;
+	void barrier_hessian(real k, const VectorX &x, vector<Eigen::Triplet<real>> &triplets, bool project = true) const;
+	/// add the diagonal of the barrier's Gauss-Newton hessian to diag, it is positive
+	void barrier_hessian_diagonal(real k, const VectorX &x, VectorX &diag) const;
+	real barrier_area = 1e-3;
+	/// Continuous collision check: largest t in [0,1] such that no face inverts between x and x + t*dx,
+	/// scaled by a safety factor so that the barrier stays finite. Faces flagged in inverted are ignored.
+	real max_step(const VectorX &x, const VectorX &dx) const;
+
+	/// Per face, whether it was inverted when update_inverted() last ran. The barrier can't recover those,
+	/// so they keep the linear penalty until they are untangled. Empty after the faces changed, then every
+	/// face with A <= 0 counts as flagged.
+	vector<char> inverted;
+	/// Flag the faces with A <= 0 in x and unflag those with A >= barrier_area, where barrier and penalty
+	/// are both zero. Flags stay fixed in between, so the energy is continuous. Returns whether a flag changed.
+	bool update_inverted(const VectorX &x);
 
 	void project(VectorX &x) const;
+
+private:
+	/// position of every vertex at the last relax(), NaN if it has to be checked
+	vector<Vector2> relaxed_positions;
+
+	/// whether face i with doubled area A gets the penalty instead of the barrier
+	bool penalized(int i, real area) const {
+		return inverted.size() == faces.size() ? inverted[i] : area <= 0;
+	}
 };
 
 }
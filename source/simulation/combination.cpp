@@ -12,6 +12,18 @@ void Combination::reset(const SimulationMesh &mesh) {
 	verlet.reset(mesh);
 }
 
+void Combination::warm_start(const SimulationMesh &mesh) {
+	// the rest lengths changed, so LBFGS has to run again, starting from the curvature of the last solve
+	lbfgs_converged = false;
+	lbfgs.warm_start(mesh);
+	verlet.warm_start(mesh);
+}
+
+void Combination::remap(const vector<int> &new_index) {
+	lbfgs.remap(new_index);
+	verlet.remap(new_index);
+}
+
 bool Combination::step(SimulationMesh &mesh) {
 	if (lbfgs_converged) {
 		return verlet.step(mesh);
@@ -19,6 +31,10 @@ bool Combination::step(SimulationMesh &mesh) {
 		lbfgs_converged = lbfgs.step(mesh);
 		if (lbfgs_converged) {
 			cout << "LBFGS converged!" << endl;
+		} else if (lbfgs.stalled) {
+			// e.g. held up by the barrier, Verlet continues from here
+			cout << "LBFGS stalled, continuing with Verlet" << endl;
+			lbfgs_converged = true;
 		}
 		return false;
 	}
@@ -11,12 +11,15 @@ namespace ruffles::simulation {
 class Combination : public Simulator {
 public:
 	LBFGS lbfgs;
+	/// LBFGS converged or stalled, Verlet takes over
 	bool lbfgs_converged = false;
 	Verlet verlet;
 
 	Combination(const SimulationMesh &mesh);
 
-	virtual void reset(const SimulationMesh &mesh);
+	virtual void reset(const SimulationMesh &mesh) override;
+	virtual void warm_start(const SimulationMesh &mesh) override;
+	virtual void remap(const vector<int> &new_index) override;
 
 	virtual bool step(SimulationMesh &mesh) override;
 
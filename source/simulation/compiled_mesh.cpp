@@ -0,0 +1,39 @@
+#include "simulation/compiled_mesh.h"
+
+namespace ruffles::simulation {
+
+void CompiledMesh::gather(const VectorX &x, VectorX &pos) const {
+	assert(x.size() == dof);
+	pos.resize(dof + fixed.size());
+	pos.head(dof) = x;
+	pos.tail(fixed.size()) = fixed;
+}
+
+void CompiledMesh::build_incidence() {
+	vector<pair<int,int>> vertex_slot; // (vertex, slot)
+	vertex_slot.reserve(num_slots());
+	for (int i = 0; i < num_bends(); i++) {
+		vertex_slot.emplace_back(bend(i).a, bend_slot(i)+0);
+		vertex_slot.emplace_back(bend(i).b, bend_slot(i)+1);
+		vertex_slot.emplace_back(bend(i).c, bend_slot(i)+2);
+	}
+	for (int i = 0; i < (int)membranes.size(); i++) {
+		vertex_slot.emplace_back(membranes[i].a, membrane_slot(i)+0);
+		vertex_slot.emplace_back(membranes[i].b, membrane_slot(i)+1);
+	}
+
+	incident_offsets.assign(num_vertices()+1, 0);
+	for (auto &[v, slot] : vertex_slot) {
+		incident_offsets[v+1]++;
+	}
+	for (int v = 0; v < num_vertices(); v++) {
+		incident_offsets[v+1] += incident_offsets[v];
+	}
+	incident_slots.resize(vertex_slot.size());
+	vector<int> fill(incident_offsets.begin(), incident_offsets.end()-1);
+	for (auto &[v, slot] : vertex_slot) {
+		incident_slots[fill[v]++] = slot;
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common/common.h"
+
+namespace ruffles::simulation {
+
+/// Flat snapshot of the SimulationMesh topology for energy evaluation.
+/// Vertices are addressed by index into an extended position vector [x; fixed],
+/// i.e. movable vertex i lives at 2*i and fixed vertex j at dof + 2*j.
+struct CompiledMesh {
+	struct Bend {
+		int a, b, c;
+		real weight; // width of b / average length of the two segments
+	};
+	struct Membrane {
+		int a, b;
+		real length;
+	};
+
+	int dof = 0;
+	VectorX fixed;
+
+	vector<Bend> bends;
+	vector<Bend> connection_bends;
+	vector<Membrane> membranes;
+
+	VectorX vertex_mass; // one entry per extended vertex
+	vector<pair<int, real>> extra_mass;
+	vector<pair<int, Vector2>> external_forces;
+
+	/// Element gradients are written to separate slots and summed per vertex in a fixed order,
+	/// bends (including connection bends) use 3 slots each followed by 2 per membrane.
+	/// incident_slots[incident_offsets[v]..incident_offsets[v+1]) are the slots of vertex v.
+	vector<int> incident_offsets;
+	vector<int> incident_slots;
+
+	int num_vertices() const {
+		return vertex_mass.size();
+	}
+	int num_bends() const {
+		return bends.size() + connection_bends.size();
+	}
+	const Bend &bend(int i) const {
+		return i < (int)bends.size() ? bends[i] : connection_bends[i - bends.size()];
+	}
+	int bend_slot(int i) const {
+		return 3*i;
+	}
+	int membrane_slot(int i) const {
+		return 3*num_bends() + 2*i;
+	}
+	int num_slots() const {
+		return membrane_slot(membranes.size());
+	}
+	bool movable(int vertex) const {
+		return 2*vertex < dof;
+	}
+
+	/// write [x; fixed] into pos
+	void gather(const VectorX &x, VectorX &pos) const;
+	/// build incident_offsets and incident_slots from the elements
+	void build_incidence();
+};
+
+}
@@ -0,0 +1,154 @@
+#include "simulation/fire.h"
+
+#include "common/imgui.h"
+
+#include <algorithm>
+
+namespace ruffles::simulation {
+
+FIRE::FIRE(const SimulationMesh &mesh) {
+	reset(mesh);
+}
+
+void FIRE::reset(const SimulationMesh &mesh) {
+	vel  = VectorX::Zero(mesh.dof());
+	grad = VectorX::Zero(mesh.dof());
+	dt = dt_start;
+	alpha = alpha_start;
+	n_positive = 0;
+	mass.resize(0);
+}
+
+void FIRE::warm_start(const SimulationMesh &mesh) {
+	if (vel.size() > mesh.dof()) {
+		reset(mesh);
+		return;
+	}
+	int old_size = vel.size();
+	vel.conservativeResize(mesh.dof());
+	vel.tail(mesh.dof()-old_size).setZero();
+	grad = VectorX::Zero(mesh.dof());
+	// the energy landscape changed, don't trust the accelerated state
+	dt = std::min(dt, dt_start);
+	alpha = alpha_start;
+	n_positive = 0;
+	mass.resize(0);
+}
+
+void FIRE::remap(const vector<int> &new_index) {
+	int n = std::count_if(new_index.begin(), new_index.end(), [](int i) { return i >= 0; });
+	VectorX new_vel = VectorX::Zero(2*n);
+	for (int i = 0; i < (int)new_index.size() && 2*i < vel.size(); i++) {
+		if (new_index[i] >= 0) {
+			new_vel.segment<2>(2*new_index[i]) = vel.segment<2>(2*i);
+		}
+	}
+	vel = new_vel;
+	grad = VectorX::Zero(2*n);
+	mass.resize(0);
+}
+
+void FIRE::project(const SimulationMesh &mesh, VectorX &force) const {
+	const VectorX &pos = mesh.x;
+	for (int i = 0; i < pos.size(); i++) {
+		int d = i % 2;
+		if ((pos(i) <= mesh.lb(d) && force(i) < 0.) || (pos(i) >= mesh.ub(d) && force(i) > 0.)) {
+			force(i) = 0.;
+		}
+	}
+}
+
+bool FIRE::step(SimulationMesh &mesh) {
+	VectorX &pos = mesh.x;
+
+	// per-dof masses from the hessian diagonal, so that the stiff membranes and the
+	// soft bending modes share one time step. They change slowly, so only every mass_interval steps.
+	if (mass.size() != pos.size() || mass_age >= mass_interval) {
+		mesh.hessian_diagonal(pos, mass);
+		mass = mass.cwiseMax(1e-8 * mass.maxCoeff()).cwiseMax(1e-12);
+		mass_age = 0;
+	}
+	mass_age++;
+
+	grad.setZero();
+	energy = mesh.energy(pos, &grad);
+	VectorX force = -grad;
+	project(mesh, force);
+	VectorX acc = force.cwiseQuotient(mass);
+
+	real power = force.dot(vel);
+	if (power > 0.) {
+		real acc_norm = acc.norm();
+		if (acc_norm > 0.) {
+			vel = (1-alpha)*vel + alpha*vel.norm()/acc_norm * acc;
+		}
+		n_positive++;
+		if (n_positive > n_min) {
+			dt = std::min(dt*f_inc, dt_max);
+			alpha *= f_alpha;
+		}
+	} else {
+		// went uphill: step back half a step and restart from rest. The way back stays in [lb, ub],
+		// clamped components have no velocity
+		pos -= mesh.max_step(pos, -0.5*dt * vel) * 0.5*dt * vel;
+		vel.setZero();
+		n_positive = 0;
+		dt = std::max(dt*f_dec, dt_min);
+		alpha = alpha_start;
+	}
+
+	// semi-implicit euler, clamped before the collision check so that it sees the actual path
+	vel += dt * acc;
+	VectorX dx = dt * vel;
+	for (int i = 0; i < pos.size(); i++) {
+		int d = i % 2;
+		real target = max(mesh.lb(d), min(mesh.ub(d), pos(i) + dx(i)));
+		if (target != pos(i) + dx(i)) {
+			dx(i) = target - pos(i);
+			vel(i) = 0.;
+		}
+	}
+	real t = mesh.max_step(pos, dx);
+	pos += t * dx;
+	if (t < 1.) {
+		// stopped in front of an air mesh triangle
+		vel.setZero();
+	}
+
+	// a blocked step is no equilibrium
+	bool converged = t > 0. && force.norm() <= epsilon * max(1., pos.norm());
+
+	if (mesh.relax_air_mesh()) {
+		return false;
+	} else {
+		return converged;
+	}
+}
+
+int FIRE::max_steps() const {
+	return max_iterations;
+}
+
+void FIRE::menu_callback() {
+	if (ImGui::InputReal("dt start", &dt_start, 0.01, 0.1)) {
+		dt_start = max(0., dt_start);
+	}
+	if (ImGui::InputReal("dt max", &dt_max, 0.1, 1.)) {
+		dt_max = max(dt_start, dt_max);
+	}
+	if (ImGui::InputReal("alpha start", &alpha_start, 0.01, 0.1)) {
+		alpha_start = max(0., min(1., alpha_start));
+	}
+	if (ImGui::InputInt("mass interval", &mass_interval)) {
+		mass_interval = std::max(1, mass_interval);
+	}
+	if (ImGui::InputInt("max iterations", &max_iterations)) {
+		max_iterations = std::max(1, max_iterations);
+	}
+	if (ImGui::InputReal("epsilon", &epsilon, 1e-6, 1e-5, "%.2e")) {
+		epsilon = max(0., epsilon);
+	}
+	ImGui::Text("dt: %.3e", dt);
+}
+
+}
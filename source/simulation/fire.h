@@ -0,0 +1,52 @@
+#pragma once
+
+#include "simulation/simulator.h"
+#include "common/common.h"
+
+namespace ruffles::simulation {
+
+/// FIRE (Fast Inertial Relaxation Engine): damped dynamics that steer the velocity
+/// towards the force while the power F.v is positive, growing dt, and stop dead otherwise.
+/// SimulationMesh::hessian_diagonal is used as mass, so dt is relative to the stiffest mode of each vertex.
+/// Positions are clamped to [lb, ub] like in Verlet. Every step() is one iteration.
+class FIRE : public Simulator {
+public:
+	FIRE(const SimulationMesh &mesh);
+
+	virtual void reset(const SimulationMesh &mesh) override;
+	virtual void warm_start(const SimulationMesh &mesh) override;
+	virtual void remap(const vector<int> &new_index) override;
+
+	virtual bool step(SimulationMesh &mesh) override;
+	virtual int max_steps() const override;
+
+	virtual void menu_callback() override;
+
+	VectorX vel;
+	VectorX grad;
+
+	real energy = std::numeric_limits<real>::infinity();
+	real dt = 0.;
+	real dt_start = 0.1;
+	real dt_max = 1.;
+	real dt_min = 1e-6;
+	real alpha = 0.;
+	real alpha_start = 0.1;
+	real f_alpha = 0.99;
+	real f_inc = 1.1;
+	real f_dec = 0.5;
+	int n_min = 5; // positive power steps before dt may grow
+	int mass_interval = 50; // steps between updates of the masses
+	int max_iterations = 20000; // cap per physics solve, each step() is a single cheap iteration
+	real epsilon = 1e-5; // tolerance on the projected force, relative to |x|
+
+private:
+	int n_positive = 0;
+	VectorX mass; // empty if it has to be recomputed
+	int mass_age = 0; // steps since the masses were computed
+
+	/// zero the force components pushing into an active bound
+	void project(const SimulationMesh &mesh, VectorX &force) const;
+};
+
+}
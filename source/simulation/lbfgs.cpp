@@ -1,42 +1,202 @@
 #include "simulation/lbfgs.h"
 
+#include "common/imgui.h"
+
+#include <algorithm>
+
 namespace ruffles::simulation {
 
-LBFGS::LBFGS(const SimulationMesh &mesh, LBFGSpp::LBFGSBParam<real> param) :
-	solver((*new LBFGSpp::LBFGSBParam<real>(param)))
-{
+LBFGS::LBFGS(const SimulationMesh &mesh) {
 	reset(mesh);
 }
 
 void LBFGS::reset(const SimulationMesh &) {
+	energy = std::numeric_limits<real>::infinity();
+	s.clear();
+	y.clear();
+	stalled = false;
+}
+
+void LBFGS::warm_start(const SimulationMesh &mesh) {
+	int n = mesh.dof();
+	if (s.size() && s.front().size() > n) {
+		// vertices were removed without a remap, the pairs can't be matched anymore
+		reset(mesh);
+		return;
+	}
+	// new vertices are appended at the end of x, the pairs have no curvature for them
+	for (auto *pairs : {&s, &y}) {
+		for (VectorX &v : *pairs) {
+			int old_size = v.size();
+			v.conservativeResize(n);
+			v.tail(n - old_size).setZero();
+		}
+	}
+	energy = std::numeric_limits<real>::infinity();
+	stalled = false;
+}
+
+void LBFGS::remap(const vector<int> &new_index) {
+	int n = std::count_if(new_index.begin(), new_index.end(), [](int i) { return i >= 0; });
+	for (auto *pairs : {&s, &y}) {
+		for (VectorX &v : *pairs) {
+			VectorX new_v = VectorX::Zero(2*n);
+			for (int i = 0; i < (int)new_index.size() && 2*i < v.size(); i++) {
+				if (new_index[i] >= 0) {
+					new_v.segment<2>(2*new_index[i]) = v.segment<2>(2*i);
+				}
+			}
+			v = new_v;
+		}
+	}
+	drop_flat_pairs();
+}
+
+void LBFGS::drop_flat_pairs() {
+	for (size_t i = 0; i < s.size();) {
+		if (s[i].dot(y[i]) > std::numeric_limits<real>::epsilon() * y[i].squaredNorm()) {
+			i++;
+		} else {
+			s.erase(s.begin() + i);
+			y.erase(y.begin() + i);
+		}
+	}
+}
+
+VectorX LBFGS::direction(const VectorX &grad, const VectorXb &active) const {
+	int k = s.size();
+	VectorX q = grad;
+	vector<real> rho(k), alpha(k);
+	for (int i = k-1; i >= 0; i--) {
+		rho[i] = 1. / s[i].dot(y[i]);
+		alpha[i] = rho[i] * s[i].dot(q);
+		q -= alpha[i] * y[i];
+	}
+	// initial inverse hessian scaled like the newest pair
+	if (k > 0) {
+		q *= s[k-1].dot(y[k-1]) / y[k-1].squaredNorm();
+	}
+	for (int i = 0; i < k; i++) {
+		real beta = rho[i] * y[i].dot(q);
+		q += (alpha[i] - beta) * s[i];
+	}
+	for (int i = 0; i < q.size(); i++) {
+		if (active(i)) {
+			q(i) = 0.;
+		}
+	}
+	return -q;
 }
 
 bool LBFGS::step(SimulationMesh &mesh) {
-	VectorX lb = mesh.lb.replicate(mesh.dof()/2, 1);
-	VectorX ub = mesh.ub.replicate(mesh.dof()/2, 1);
+	VectorX &x = mesh.x;
+	int n = x.size();
+	if (s.size() && s.front().size() != n) {
+		// the vertices changed without reset()
+		s.clear();
+		y.clear();
+	}
+
+	VectorX grad = VectorX::Zero(n);
+	energy = mesh.energy(x, &grad);
+	real start_energy = energy;
 
-	auto f = [&] (const VectorX &x, VectorX &grad) -> real {
-		grad.setZero();
-		real e = mesh.energy(x, &grad);
-		return e;
-	};
+	bool converged = false;
+	VectorX x_new(n), grad_new(n);
+	for (int iteration = 0; iteration < max_iterations; iteration++) {
+		// active set of the box constraints
+		VectorXb active(n);
+		VectorX projected_grad = grad;
+		for (int i = 0; i < n; i++) {
+			active(i) = (x(i) <= mesh.lb(i%2) && grad(i) > 0.) || (x(i) >= mesh.ub(i%2) && grad(i) < 0.);
+			if (active(i)) {
+				projected_grad(i) = 0.;
+			}
+		}
+		converged = projected_grad.norm() <= epsilon * max(1., x.norm());
+		if (converged) {
+			break;
+		}
 
-	bool lbfgs_converged = false;
-	try {
-		int nsteps = solver.minimize(f, mesh.x, energy, lb, ub);
-		(void)nsteps;
-	} catch(std::runtime_error &e) {
-		dbg(e.what());
-		lbfgs_converged = true;
+		VectorX dir = direction(projected_grad, active);
+		if (!(dir.dot(projected_grad) < 0.)) {
+			// the pairs don't describe the free variables well enough, start over
+			s.clear();
+			y.clear();
+			dir = -projected_grad;
+		}
+
+		// backtracking line search along the projected path. Without pairs the direction has
+		// no scale, so the first trial moves by at most one unit
+		real alpha = s.empty() ? min(1., 1. / dir.norm()) : 1.;
+		// start inside the collision free part of the step, the barrier is infinite beyond
+		alpha *= mesh.max_step(x, alpha * dir);
+		bool accepted = false;
+		real e = energy;
+		for (int attempt = 0; attempt < max_linesearch && alpha > 0.; attempt++, alpha *= 0.5) {
+			x_new = x + alpha * dir;
+			for (int i = 0; i < n; i++) {
+				x_new(i) = max(mesh.lb(i%2), min(mesh.ub(i%2), x_new(i)));
+			}
+			// clamping changed the path, it has to be collision free as well
+			if (mesh.max_step(x, x_new - x) < 1.) {
+				continue;
+			}
+			grad_new.setZero();
+			e = mesh.energy(x_new, &grad_new);
+			if (e <= energy + 1e-4 * grad.dot(x_new - x)) {
+				accepted = true;
+				break;
+			}
+		}
+		if (!accepted) {
+			if (s.empty()) {
+				break; // no decrease along the projected gradient either, e.g. held up by the barrier
+			}
+			s.clear();
+			y.clear();
+			continue;
+		}
+
+		// only pairs with positive curvature keep the approximation positive definite
+		VectorX s_new = x_new - x;
+		VectorX y_new = grad_new - grad;
+		if (s_new.dot(y_new) > std::numeric_limits<real>::epsilon() * y_new.squaredNorm()) {
+			s.push_back(s_new);
+			y.push_back(y_new);
+			if ((int)s.size() > history) {
+				s.pop_front();
+				y.pop_front();
+			}
+		}
+
+		real previous_energy = energy;
+		x.swap(x_new);
+		grad.swap(grad_new);
+		energy = e;
+		// the decrease is below round-off, the gradient criterion may never be met
+		if (previous_energy - energy <= delta * std::abs(energy)) {
+			converged = true;
+			break;
+		}
 	}
+	stalled = !(energy < start_energy);
 
 	if (mesh.relax_air_mesh()) {
 		return false; // air mesh changed, run again
 	} else {
-		return lbfgs_converged;
+		return converged;
 	}
 }
 
-void LBFGS::menu_callback() {}
+void LBFGS::menu_callback() {
+	if (ImGui::InputInt("history", &history)) {
+		history = std::max(1, history);
+	}
+	if (ImGui::InputReal("epsilon", &epsilon, 1e-6, 1e-5, "%.2e")) {
+		epsilon = max(0., epsilon);
+	}
+	ImGui::Text("Stored pairs: %d", (int)s.size());
+}
 
 }
@@ -4,22 +4,43 @@
 
 #include "simulation/simulator.h"
 
-#include <LBFGSB.h>
+#include <deque>
 
 namespace ruffles::simulation {
 
+/// Limited memory BFGS for the [lb, ub] box: the two-loop recursion on the free variables and a
+/// backtracking line search along the clamped path. Trial points are limited by SimulationMesh::max_step,
+/// so no step inverts an air mesh triangle. Every step() iterates until convergence or max_iterations.
+/// warm_start() keeps the (s, y) pairs of the previous solve as initial curvature.
 class LBFGS : public Simulator {
 public:
-	LBFGS(const SimulationMesh &mesh, LBFGSpp::LBFGSBParam<real> param = LBFGSpp::LBFGSBParam<real>());
+	LBFGS(const SimulationMesh &mesh);
 
-	virtual void reset(const SimulationMesh &mesh);
+	virtual void reset(const SimulationMesh &mesh) override;
+	virtual void warm_start(const SimulationMesh &mesh) override;
+	virtual void remap(const vector<int> &new_index) override;
 
 	virtual bool step(SimulationMesh &mesh) override;
 
 	virtual void menu_callback() override;
 
-	LBFGSpp::LBFGSBSolver<real> solver;
-	real energy;
+	real energy = std::numeric_limits<real>::infinity();
+	int history = 6; // number of (s, y) pairs
+	int max_iterations = 1000; // per step()
+	real epsilon = 1e-5; // tolerance on the projected gradient, relative to |x|
+	real delta = 1e-12; // tolerance on the energy decrease, relative to |energy|
+	int max_linesearch = 40; // halvings of the step before giving up
+	/// the last step() didn't decrease the energy
+	bool stalled = false;
+
+private:
+	// s = x_{k+1} - x_k and y = grad_{k+1} - grad_k, oldest first
+	std::deque<VectorX> s, y;
+
+	/// drop the pairs without positive curvature, e.g. after vertices were removed
+	void drop_flat_pairs();
+	/// -H grad with the inverse hessian approximation of the pairs, zero on the active variables
+	VectorX direction(const VectorX &grad, const VectorXb &active) const;
 };
 
 }
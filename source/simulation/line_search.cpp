@@ -25,9 +25,12 @@ bool LineSearch::step(SimulationMesh &mesh) {
 	dir *= -1;
 	dir.normalize();
 
+	// never step through an air mesh triangle
+	real max_step = mesh.max_step(mesh.x, step_size * dir);
+
 	int iterations = 0;
 	while (iterations < 100) {
-		VectorX x = mesh.x + step_size * dir;
+		VectorX x = mesh.x + max_step * step_size * dir;
 		real f = mesh.energy(x, nullptr);
 		dbg(f);
 		dbg(f0);
@@ -4,15 +4,13 @@
 
 #include "simulation/simulator.h"
 
-#include <LBFGSB.h>
-
 namespace ruffles::simulation {
 
 class LineSearch : public Simulator {
 public:
 	LineSearch(const SimulationMesh &mesh);
 
-	virtual void reset(const SimulationMesh &mesh);
+	virtual void reset(const SimulationMesh &mesh) override;
 
 	virtual bool step(SimulationMesh &mesh) override;
 
@@ -0,0 +1,167 @@
+#include "simulation/newton.h"
+
+#include "common/imgui.h"
+
+namespace ruffles::simulation {
+
+Newton::Newton(const SimulationMesh &mesh) {
+	reset(mesh);
+}
+
+void Newton::reset(const SimulationMesh &) {
+	energy = std::numeric_limits<real>::infinity();
+}
+
+void Newton::assemble(int n) {
+	auto same_pattern = [&]() {
+		if (!has_pattern || hessian.rows() != n || slots.size() != triplets.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < triplets.size(); i++) {
+			int slot = slots[i];
+			int col = triplets[i].col();
+			if (slot < hessian.outerIndexPtr()[col] ||
+			    slot >= hessian.outerIndexPtr()[col+1] ||
+			    hessian.innerIndexPtr()[slot] != triplets[i].row()) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	if (!same_pattern()) {
+		hessian.resize(n, n);
+		hessian.setFromTriplets(triplets.begin(), triplets.end());
+		hessian.makeCompressed();
+
+		slots.resize(triplets.size());
+		for (size_t i = 0; i < triplets.size(); i++) {
+			int col = triplets[i].col();
+			const int *begin = hessian.innerIndexPtr() + hessian.outerIndexPtr()[col];
+			const int *end   = hessian.innerIndexPtr() + hessian.outerIndexPtr()[col+1];
+			slots[i] = std::lower_bound(begin, end, triplets[i].row()) - hessian.innerIndexPtr();
+		}
+
+		solver.analyzePattern(hessian);
+		has_pattern = true;
+		analyze_count++;
+	}
+
+	// same pattern: scatter the values directly, keep the symbolic factorization
+	real *values = hessian.valuePtr();
+	std::fill(values, values + hessian.nonZeros(), 0.);
+	for (size_t i = 0; i < triplets.size(); i++) {
+		values[slots[i]] += triplets[i].value();
+	}
+}
+
+bool Newton::factorize(const VectorXb &active, real shift) {
+	// decouple active variables: identity rows and columns keep the pattern intact
+	for (int col = 0; col < hessian.outerSize(); col++) {
+		for (SparseMatrix::InnerIterator it(hessian, col); it; ++it) {
+			if (active(it.row()) || active(it.col())) {
+				it.valueRef() = it.row() == it.col() ? 1. : 0.;
+			} else if (it.row() == it.col()) {
+				it.valueRef() += shift;
+			}
+		}
+	}
+	solver.factorize(hessian);
+	factorize_count++;
+	return solver.info() == Eigen::Success;
+}
+
+bool Newton::step(SimulationMesh &mesh) {
+	VectorX &x = mesh.x;
+	int n = x.size();
+
+	VectorX grad = VectorX::Zero(n);
+	energy = mesh.energy(x, &grad);
+
+	// active set of the box constraints
+	VectorXb active(n);
+	VectorX projected_grad = grad;
+	for (int i = 0; i < n; i++) {
+		real lb = mesh.lb(i%2);
+		real ub = mesh.ub(i%2);
+		active(i) = (x(i) <= lb && grad(i) > 0.) || (x(i) >= ub && grad(i) < 0.);
+		if (active(i)) {
+			projected_grad(i) = 0.;
+		}
+	}
+
+	bool converged = projected_grad.norm() <= epsilon * max(1., x.norm());
+
+	if (!converged) {
+		// the exact hessian is positive definite close to the equilibrium, otherwise
+		// fall back to the projected one and shift it until the solve succeeds
+		VectorX dir;
+		for (bool project : {false, true}) {
+			triplets.clear();
+			for (int i = 0; i < n; i++) {
+				triplets.emplace_back(i, i, 0.); // keep the diagonal in the pattern
+			}
+			mesh.hessian(x, triplets, project);
+
+			real shift = 0.;
+			for (int attempt = 0; attempt < (project ? 10 : 1); attempt++) {
+				assemble(n);
+				if (factorize(active, shift) && (project || (solver.vectorD().array() > 0.).all())) {
+					dir = -solver.solve(projected_grad);
+					if (dir.allFinite() && dir.dot(projected_grad) < 0.) {
+						break;
+					}
+				}
+				dir.resize(0);
+				shift = max(10.*shift, 1e-8 * hessian.diagonal().cwiseAbs().maxCoeff());
+			}
+			if (dir.size()) {
+				break;
+			}
+		}
+
+		// backtracking line search along the projected path
+		real previous_energy = energy;
+		bool accepted = false;
+		// the quadratic model predicts less decrease than round-off, the full step would be noise
+		bool at_minimum = dir.size() && -0.5 * projected_grad.dot(dir) <= delta * std::abs(energy);
+		if (dir.size() && !at_minimum) {
+			// start inside the collision free part of the step, the barrier is infinite beyond
+			for (real alpha = mesh.max_step(x, dir); alpha > min_step; alpha *= 0.5) {
+				VectorX x_new = x + alpha * dir;
+				for (int i = 0; i < n; i++) {
+					x_new(i) = max(mesh.lb(i%2), min(mesh.ub(i%2), x_new(i)));
+				}
+				// clamping changed the path, it has to be collision free as well
+				if (mesh.max_step(x, x_new - x) < 1.) {
+					continue;
+				}
+				real e = mesh.energy(x_new, nullptr);
+				if (e <= energy + 1e-4 * grad.dot(x_new - x)) {
+					x = x_new;
+					energy = e;
+					accepted = true;
+					break;
+				}
+			}
+		}
+		// a step that was not taken doesn't show convergence, only a decrease below round-off does
+		converged = at_minimum || (accepted && previous_energy - energy <= delta * std::abs(energy));
+	}
+
+	if (mesh.relax_air_mesh()) {
+		return false; // air mesh changed, run again
+	} else {
+		return converged;
+	}
+}
+
+void Newton::menu_callback() {
+	if (ImGui::InputReal("epsilon", &epsilon, 1e-6, 1e-5, "%.2e")) {
+		epsilon = max(0., epsilon);
+	}
+	ImGui::Text("Symbolic factorizations: %d", analyze_count);
+	ImGui::Text("Numeric factorizations: %d", factorize_count);
+}
+
+}
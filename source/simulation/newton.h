@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common/common.h"
+
+#include "simulation/simulator.h"
+
+#include <Eigen/SparseCholesky>
+
+namespace ruffles::simulation {
+
+/// Projected Newton method with a sparse LDLT solve per step.
+/// Variables at an active bound of [lb, ub] are held fixed for the step.
+class Newton : public Simulator {
+public:
+	Newton(const SimulationMesh &mesh);
+
+	virtual void reset(const SimulationMesh &mesh) override;
+
+	virtual bool step(SimulationMesh &mesh) override;
+
+	virtual void menu_callback() override;
+
+	real energy = std::numeric_limits<real>::infinity();
+	real epsilon = 1e-5; // tolerance on the projected gradient, relative to |x|
+	real delta = 1e-12; // tolerance on the energy decrease, relative to |energy|
+	real min_step = 1e-10;
+	int analyze_count = 0;
+	int factorize_count = 0;
+
+private:
+	using SparseMatrix = Eigen::SparseMatrix<real>;
+
+	vector<Eigen::Triplet<real>> triplets;
+	vector<int> slots; // value index in hessian for each triplet
+	SparseMatrix hessian;
+	Eigen::SimplicialLDLT<SparseMatrix> solver;
+	bool has_pattern = false;
+
+	void assemble(int n);
+	bool factorize(const VectorXb &active, real shift);
+};
+
+}
@@ -1,5 +1,9 @@
 #include "simulation/simulation_mesh.h"
+#include "common/thread_pool.h"
 #include <numeric>
+#include <unordered_map>
+
+#include <igl/parallel_for.h>
 
 
 namespace ruffles::simulation {
@@ -7,12 +11,27 @@ namespace ruffles::simulation {
 using Segment = SimulationMesh::Segment;
 using Vertex = SimulationMesh::Vertex;
 
+// loops over fewer elements stay single-threaded
+constexpr int min_parallel = 1000;
+// corners per call of the batched angle kernel
+constexpr int bend_block = 256;
+
 listref<Vertex> SimulationMesh::push_vertex(Vector2 position, bool fixed) {
+	// the new vertex is not part of the triangulation
 	air_mesh.clear();
+	return add_vertex(position, fixed);
+}
+
+listref<Vertex> SimulationMesh::add_vertex(Vector2 position, bool fixed) {
+	invalidate_compiled();
 	if (fixed) {
 		return vertices.insert(vertices.end(), Vertex(position));
+	} else if (builders > 0) {
+		int index = (x.size() + staged_x.size())/2;
+		staged_x.push_back(position.x());
+		staged_x.push_back(position.y());
+		return vertices.insert(vertices.end(), Vertex(index));
 	} else {
-		// TODO: don't reallocate every single time
 		x.conservativeResize(x.size()+2);
 		x.tail<2>() = position;
 		m.conservativeResize(dof());
@@ -23,16 +42,47 @@ listref<Vertex> SimulationMesh::push_vertex(Vector2 position, bool fixed) {
 	}
 }
 
+SimulationMesh::Builder::Builder(SimulationMesh &mesh, int vertices, int segments)
+ : mesh(mesh) {
+	mesh.builders++;
+	mesh.staged_x.reserve(mesh.staged_x.size() + 2*vertices);
+	mesh.vertices.reserve(vertices);
+	mesh.segments.reserve(segments);
+}
+
+SimulationMesh::Builder::~Builder() {
+	finish();
+}
+
+void SimulationMesh::Builder::finish() {
+	if (finished) {
+		return;
+	}
+	finished = true;
+	if (--mesh.builders > 0 || mesh.staged_x.empty()) {
+		return;
+	}
+	int old_dof = mesh.x.size();
+	int new_dof = old_dof + mesh.staged_x.size();
+	mesh.x.conservativeResize(new_dof);
+	mesh.x.tail(new_dof - old_dof) = Eigen::Map<const VectorX>(mesh.staged_x.data(), mesh.staged_x.size());
+	mesh.m.conservativeResize(new_dof);
+	mesh.m.tail(new_dof - old_dof).setOnes(); // placeholder masses until update_vertex_mass()
+	mesh.staged_x.clear();
+	mesh.invalidate_compiled();
+}
+
 listref<Segment> SimulationMesh::push_segment(listref<Vertex> a, listref<Vertex> b, real length) {
 	return insert_segment(a,b,length,segments.end());
 }
 listref<Segment> SimulationMesh::insert_segment(listref<Vertex> a, listref<Vertex> b, real length, listref<Segment> position) {
+	invalidate_compiled();
 	return segments.insert(position, Segment(a,b,length));
 }
 
 array<listref<Segment>, 2> SimulationMesh::split_segment(listref<Segment> seg) {
 	Vector2 center_pos = 0.5 * (get_vertex_position(*seg->start) + get_vertex_position(*seg->end));
-	listref<Vertex> center = push_vertex(center_pos);
+	listref<Vertex> center = add_vertex(center_pos);
 	center->width = 0.5*(seg->start->width + seg->end->width);
 	if (seg->start->z.size() && seg->end->z.size()) {
 		center->z = {
@@ -44,49 +94,18 @@ array<listref<Segment>, 2> SimulationMesh::split_segment(listref<Segment> seg) {
 	listref<Segment> a = insert_segment(seg->start, center, 0.5*seg->length, seg);
 	listref<Segment> b = insert_segment(center, seg->end, 0.5*seg->length, seg);
 
-	auto mark_constrained = [this](auto f, int i, bool constrained) {
-		f->set_constraint(i, constrained);
-		f->neighbor(i)->set_constraint(air_mesh.cdt.mirror_index(f,i), constrained);
-	};
-
-	if (!air_mesh.empty()) {
-		// TODO: update air mesh
-		int center_ix = air_mesh.vertices.size();
-		air_mesh.vertices.push_back(static_cast<std::variant<Vector2,int>>(*center));
-		int start_ix = std::distance(vertices.begin(), seg->start);
-		int end_ix   = std::distance(vertices.begin(), seg->end);
-
-		// TODO: find the edge faster
-		for (auto it = air_mesh.cdt.finite_edges_begin(); it != air_mesh.cdt.finite_edges_end(); ++it) {
-			if (it->first->vertex((it->second+1)%3)->info() == start_ix &&
-			    it->first->vertex((it->second+2)%3)->info() == end_ix) {
-				mark_constrained(it->first, it->second, false);
-				auto center_vx = air_mesh.cdt.tds().insert_in_edge(it->first, it->second);
-				center_vx->info() = center_ix;
-				auto c = center_vx->incident_edges();
-				bool found_first = false;
-				bool found_second = false;
-				do {
-					if ((c->first->vertex((c->second+1)%3)->info() == start_ix)
-					 || (c->first->vertex((c->second+1)%3)->info() == end_ix)
-					 || (c->first->vertex((c->second+2)%3)->info() == start_ix)
-					 || (c->first->vertex((c->second+2)%3)->info() == end_ix)) {
-						mark_constrained(c->first, c->second, true);
-					}
-				} while (++c != center_vx->incident_edges());
-				
-				cout << "Found!!!!" << endl;
-				break;
-			}
-		}
+	if (!air_mesh.empty() && !air_mesh.split_constraint(&*seg->start, &*seg->end, &*center, center_pos)) {
+		// the segment is not in the air mesh, it has to be regenerated
+		air_mesh.clear();
 	}
 	segments.erase(seg);
+	invalidate_compiled();
 
 	return {a,b};
 	
 }
 
-void SimulationMesh::cleanup() {
+vector<int> SimulationMesh::cleanup() {
 	int dof_old = dof()/2;
 	vector<bool> used(dof_old, false);
 
@@ -96,11 +115,13 @@ void SimulationMesh::cleanup() {
 		}
 	}
 	
-	vector<int> newindex(dof_old, 0);
+	vector<int> newindex(dof_old, -1);
 	int dof_new = 0;
 	for (int i = 0; i < dof_old; i++) {
-		newindex[i] = dof_new;
-		dof_new += used[i];
+		if (used[i]) {
+			newindex[i] = dof_new;
+			dof_new++;
+		}
 	}
 
 	for (auto &v : vertices) {
@@ -117,9 +138,13 @@ void SimulationMesh::cleanup() {
 	}
 	assert(!new_x.hasNaN());
 	x = new_x;
+	invalidate_compiled();
+
+	return newindex;
 }
 
 void SimulationMesh::update_vertex_mass() {
+	assert(staged_x.empty());
 	for (auto &vert : vertices) {
 		vert.mass = 0.;
 	}
@@ -134,6 +159,7 @@ void SimulationMesh::update_vertex_mass() {
 			m.segment<2>(2**ix) = Vector2(vert.mass, vert.mass);
 		}
 	}
+	invalidate_compiled();
 }
 
 Vector2 SimulationMesh::get_vertex_position(Vertex &vx) const {
@@ -142,53 +168,66 @@ Vector2 SimulationMesh::get_vertex_position(Vertex &vx) const {
 		res = *fixed;
 	}
 	if (auto index = get_if<int>(&vx)) {
-		res = x.segment<2>(2**index);
+		if (2**index < x.size()) {
+			res = x.segment<2>(2**index);
+		} else {
+			// staged by a Builder
+			int i = 2**index - x.size();
+			res = Vector2(staged_x[i], staged_x[i+1]);
+		}
 	}
 	return res;
 }
 
-real SimulationMesh::energy(const VectorX &x, VectorX *grad) const {
-	auto get_vertex = [&](Vertex &vx) -> Vector2 {
-		return get_vertex_position(vx);
-	};
+void SimulationMesh::invalidate_compiled() {
+	_compiled_valid = false;
+}
 
-	if (grad) {
-		grad->setZero();
-		assert(x.size() == grad->size());
+const CompiledMesh &SimulationMesh::compiled() const {
+	if (!_compiled_valid) {
+		compile();
 	}
+	return _compiled;
+}
 
+void SimulationMesh::compile() const {
+	CompiledMesh &res = _compiled;
+	res = CompiledMesh();
+	res.dof = dof();
+
+	// movable vertices keep their index into x, fixed vertices are appended after
+	std::unordered_map<const Vertex *, int> index;
+	int num_fixed = 0;
+	for (auto &vx : vertices) {
+		if (const int *ix = get_if<int>(&vx)) {
+			index.emplace(&vx, *ix);
+		} else {
+			index.emplace(&vx, dof()/2 + num_fixed);
+			num_fixed++;
+		}
+	}
 
-	real res = 0.;
-
-	// bending energy
-	Vector6 grad_theta = Vector6::Zero();
-	auto add_bending_energy = [&](listref<Vertex> a, listref<Vertex> b, listref<Vertex> c, real avg_length) {
-		Vector6 corner;
-		corner <<
-			get_vertex(*a),
-			get_vertex(*b),
-			get_vertex(*c);
-
-		real theta = angle(corner, grad ? &grad_theta : nullptr);
-		real theta_tilde = M_PI;
-
-		real energy_local = (theta-theta_tilde)*(theta-theta_tilde);
-		res += k_global*k_bend*b->width/avg_length * energy_local;
-		if (grad) {
-			real fac = k_global*k_bend*b->width/avg_length*2*(theta-theta_tilde);
-			if (int *ax = get_if<int>(&*a))
-				grad->segment<2>(2**ax) += fac * grad_theta.segment<2>(0);
-			if (int *bx = get_if<int>(&*b))
-				grad->segment<2>(2**bx) += fac * grad_theta.segment<2>(2);
-			if (int *cx = get_if<int>(&*c))
-				grad->segment<2>(2**cx) += fac * grad_theta.segment<2>(4);
+	res.fixed.resize(2*num_fixed);
+	res.vertex_mass = VectorX::Zero(dof()/2 + num_fixed);
+	for (auto &vx : vertices) {
+		int i = index[&vx];
+		if (const Vector2 *pos = get_if<Vector2>(&vx)) {
+			res.fixed.segment<2>(2*i - dof()) = *pos;
 		}
+		res.vertex_mass(i) += vx.mass;
+	}
+
+	auto make_bend = [&](listref<Vertex> a, listref<Vertex> b, listref<Vertex> c, real avg_length) {
+		return CompiledMesh::Bend{index[&*a], index[&*b], index[&*c], b->width/avg_length};
 	};
 
-	for (auto it = segments.begin(); std::next(it) != segments.end(); ++it) {
+	res.bends.reserve(segments.size());
+	for (auto it = segments.begin(); it != segments.end() && std::next(it) != segments.end(); ++it) {
 		assert(it->end == std::next(it)->start);
-		add_bending_energy(it->start, it->end, std::next(it)->end, 0.5*(it->length + std::next(it)->length));
+		res.bends.push_back(make_bend(it->start, it->end, std::next(it)->end, 0.5*(it->length + std::next(it)->length)));
 	}
+
+	res.connection_bends.reserve(connection_bends.size());
 	for (auto &[a,b] : connection_bends) {
 		array<listref<Vertex>, 4> points {
 			a->start,
@@ -197,6 +236,7 @@ real SimulationMesh::energy(const VectorX &x, VectorX *grad) const {
 			b->end,
 		};
 
+		// y is the shared vertex, x and z the outer ones
 		listref<Vertex> x,y,z;
 		for (int i = 0; i < 4; i++) {
 			for (int j = i+1; j < 4; j++) {
@@ -217,62 +257,305 @@ real SimulationMesh::energy(const VectorX &x, VectorX *grad) const {
 			}
 		}
 
-		add_bending_energy(x,y,z, 0.5*(a->length + b->length));
+		res.connection_bends.push_back(make_bend(x,y,z, 0.5*(a->length + b->length)));
+	}
+
+	res.membranes.reserve(segments.size());
+	for (auto &seg : segments) {
+		res.membranes.push_back(CompiledMesh::Membrane{index[&*seg.start], index[&*seg.end], seg.length});
+	}
+
+	for (auto &[v, m] : extra_mass) {
+		res.extra_mass.emplace_back(index[&*v], m);
+	}
+	for (auto &[v, f] : external_forces) {
+		res.external_forces.emplace_back(index[&*v], f);
+	}
+
+	res.build_incidence();
+
+	_compiled_valid = true;
+}
+
+real SimulationMesh::energy(const VectorX &x, VectorX *grad) const {
+	energy_evaluations++;
+	const CompiledMesh &mesh = compiled();
+
+	VectorX pos;
+	mesh.gather(x, pos);
+
+	if (grad) {
+		assert(x.size() == grad->size());
+	}
+
+	// Every element writes only its own energy and gradient slots, so the loops run in parallel.
+	// Summing them in a fixed order afterwards keeps the result independent of the thread count.
+	VectorX element_energy(mesh.num_bends() + mesh.membranes.size());
+	Matrix<real, 2, -1> element_grad;
+	if (grad) {
+		element_grad.resize(2, mesh.num_slots());
 	}
 
+	// bending energy, the corners are evaluated in blocks by the batched angle kernel
+	int num_bend_blocks = (mesh.num_bends() + bend_block - 1) / bend_block;
+	igl::parallel_for(num_bend_blocks, [&](int block) {
+		int begin = block * bend_block;
+		int n = std::min(bend_block, mesh.num_bends() - begin);
+
+		MatrixX6 corners(n, 6);
+		for (int j = 0; j < n; j++) {
+			const CompiledMesh::Bend &bend = mesh.bend(begin + j);
+			corners.row(j) <<
+				pos.segment<2>(2*bend.a).transpose(),
+				pos.segment<2>(2*bend.b).transpose(),
+				pos.segment<2>(2*bend.c).transpose();
+		}
+
+		VectorX theta;
+		MatrixX6 grad_theta;
+		angle(corners, theta, grad ? &grad_theta : nullptr);
+		real theta_tilde = M_PI;
+
+		for (int j = 0; j < n; j++) {
+			int i = begin + j;
+			real weight = mesh.bend(i).weight;
+			real energy_local = (theta(j)-theta_tilde)*(theta(j)-theta_tilde);
+			element_energy(i) = k_global*k_bend*weight * energy_local;
+			if (grad) {
+				real fac = k_global*k_bend*weight*2*(theta(j)-theta_tilde);
+				int slot = mesh.bend_slot(i);
+				element_grad.col(slot+0) = fac * grad_theta.row(j).segment<2>(0).transpose();
+				element_grad.col(slot+1) = fac * grad_theta.row(j).segment<2>(2).transpose();
+				element_grad.col(slot+2) = fac * grad_theta.row(j).segment<2>(4).transpose();
+			}
+		}
+	}, parallel_threshold(std::max(1, min_parallel / bend_block)));
+
 	// membrane energy / constraint
-	for (auto seg : segments) {
+	igl::parallel_for((int)mesh.membranes.size(), [&](int i) {
+		const CompiledMesh::Membrane &seg = mesh.membranes[i];
 		real h_tilde = seg.length;
-		Vector2 a = get_vertex(*seg.start);
-		Vector2 b = get_vertex(*seg.end);
-		Vector2 d = b-a;
-		
+		Vector2 d = pos.segment<2>(2*seg.b) - pos.segment<2>(2*seg.a);
+
 		real h = d.norm();
 
-		res += k_global * lambda_membrane * (h-h_tilde)*(h-h_tilde);
+		element_energy(mesh.num_bends() + i) = k_global * lambda_membrane * (h-h_tilde)*(h-h_tilde);
 
 		if (grad) {
-			Vector2 dhda = 1/(2*h) * -d;
-			Vector2 dhdb = 1/(2*h) *  d;
-			if (int *ix = get_if<int>(&*seg.start))
-				grad->segment<2>(2**ix) += k_global*lambda_membrane * 2*(h-h_tilde)*dhda;
-			if (int *ix = get_if<int>(&*seg.end))
-				grad->segment<2>(2**ix) += k_global*lambda_membrane * 2*(h-h_tilde)*dhdb;
+			Vector2 dhda = 1/h * -d;
+			Vector2 dhdb = 1/h *  d;
+			int slot = mesh.membrane_slot(i);
+			element_grad.col(slot+0) = k_global*lambda_membrane * 2*(h-h_tilde)*dhda;
+			element_grad.col(slot+1) = k_global*lambda_membrane * 2*(h-h_tilde)*dhdb;
 		}
-	}
-	
+	}, parallel_threshold(min_parallel));
+
+	real res = element_energy.sum();
+
 	// gravity
 
 	// intrinsic mass
-	for (auto vert : vertices) {
-		res -= k_global * vert.mass * get_vertex_position(vert).dot(gravity);
-		if (grad) {
-			if (int *ix = get_if<int>(&vert)) {
-				grad->segment<2>(2**ix) -= k_global * vert.mass * gravity;
-			}
-		}
+	for (int i = 0; i < mesh.num_vertices(); i++) {
+		res -= k_global * mesh.vertex_mass(i) * pos.segment<2>(2*i).dot(gravity);
 	}
 
 	// extrinsic mass
-	for (auto &[v, m] : extra_mass) {
-		if (int *ix = get_if<int>(&*v)) {
-			grad->segment<2>(2**ix) -= k_global * m * gravity;
-		}
+	for (auto &[v, m] : mesh.extra_mass) {
+		res -= k_global * m * pos.segment<2>(2*v).dot(gravity);
 	}
 
 	// external forces
-	for (auto &[v, f] : external_forces) {
-		res += get_vertex_position(*v).dot(f);
-		if (int *ix = get_if<int>(&*v)) {
-			grad->segment<2>(2**ix) -= k_global * f;
+	for (auto &[v, f] : mesh.external_forces) {
+		res -= k_global * pos.segment<2>(2*v).dot(f);
+	}
+
+	if (grad) {
+		// gather the element gradients of each movable vertex
+		igl::parallel_for(dof()/2, [&](int v) {
+			Vector2 g = -k_global * mesh.vertex_mass(v) * gravity;
+			for (int i = mesh.incident_offsets[v]; i < mesh.incident_offsets[v+1]; i++) {
+				g += element_grad.col(mesh.incident_slots[i]);
+			}
+			grad->segment<2>(2*v) = g;
+		}, parallel_threshold(min_parallel));
+
+		for (auto &[v, m] : mesh.extra_mass) {
+			if (mesh.movable(v)) {
+				grad->segment<2>(2*v) -= k_global * m * gravity;
+			}
+		}
+		for (auto &[v, f] : mesh.external_forces) {
+			if (mesh.movable(v)) {
+				grad->segment<2>(2*v) -= k_global * f;
+			}
 		}
 	}
-	
-	res += air_mesh.penalty(k_global * lambda_air_mesh, x, grad);
 
+	if (air_mesh_barrier) {
+		res += air_mesh.barrier(k_global * lambda_air_mesh, x, grad);
+	} else {
+		res += air_mesh.penalty(k_global * lambda_air_mesh, x, grad);
+	}
+
+	return res;
+}
+
+// gradient of the signed turning angle at b, which stays well-defined for straight corners
+static Vector6 signed_angle_gradient(const Vector6 &corner) {
+	Vector2 e1 = corner.segment<2>(2) - corner.segment<2>(0);
+	Vector2 e2 = corner.segment<2>(4) - corner.segment<2>(2);
+	Vector2 d1 = Vector2(-e1.y(), e1.x()) / e1.squaredNorm();
+	Vector2 d2 = Vector2(-e2.y(), e2.x()) / e2.squaredNorm();
+	Vector6 res;
+	res << d1, -d1-d2, d2;
 	return res;
 }
 
+void SimulationMesh::hessian(const VectorX &x, vector<Eigen::Triplet<real>> &triplets, bool project) const {
+	const CompiledMesh &mesh = compiled();
+
+	VectorX pos;
+	mesh.gather(x, pos);
+
+	// scatter an element hessian, dropping rows and columns of fixed vertices
+	auto add_element = [&](auto hess, std::initializer_list<int> indices) {
+		int i = 0;
+		for (int vi : indices) {
+			int j = 0;
+			for (int vj : indices) {
+				if (mesh.movable(vi) && mesh.movable(vj)) {
+					addHessianBlock(hess.template block<2,2>(2*i, 2*j), 2*vi, 2*vj, triplets);
+				}
+				j++;
+			}
+			i++;
+		}
+	};
+
+	// bending energy
+	auto add_bending_hessian = [&](const CompiledMesh::Bend &bend) {
+		Vector6 corner;
+		corner <<
+			pos.segment<2>(2*bend.a),
+			pos.segment<2>(2*bend.b),
+			pos.segment<2>(2*bend.c);
+
+		Vector6 grad_theta;
+		Matrix6 hess_theta;
+		real theta = angle(corner, &grad_theta, &hess_theta);
+		real theta_tilde = M_PI;
+
+		if (std::abs(theta-theta_tilde) < 1e-6) {
+			// angle() has no derivatives here, use the limit (theta-pi)^2 ~ phi^2
+			grad_theta = signed_angle_gradient(corner);
+			hess_theta.setZero();
+		}
+
+		real fac = k_global*k_bend*bend.weight;
+		Matrix6 hess = 2*fac*(grad_theta*grad_theta.transpose() + (theta-theta_tilde)*hess_theta);
+		add_element(project ? project_positive_definite<6>(hess) : hess, {bend.a, bend.b, bend.c});
+	};
+
+	for (auto &bend : mesh.bends) {
+		add_bending_hessian(bend);
+	}
+	for (auto &bend : mesh.connection_bends) {
+		add_bending_hessian(bend);
+	}
+
+	// membrane energy, projecting drops the negative curvature of compressed segments
+	for (auto &seg : mesh.membranes) {
+		Vector2 d = pos.segment<2>(2*seg.b) - pos.segment<2>(2*seg.a);
+		real h = d.norm();
+		Vector2 n = d / h;
+
+		Matrix2 nn = n * n.transpose();
+		real stretch = (h-seg.length)/h;
+		if (project) {
+			stretch = max(0., stretch);
+		}
+		Matrix2 k = 2*k_global*lambda_membrane * (nn + stretch * (Matrix2::Identity() - nn));
+
+		Matrix4 hess;
+		hess <<
+			 k, -k,
+			-k,  k;
+		add_element(hess, {seg.a, seg.b});
+	}
+
+	// gravity and external forces are linear
+
+	if (air_mesh_barrier) {
+		air_mesh.barrier_hessian(k_global * lambda_air_mesh, x, triplets, project);
+	} else {
+		air_mesh.penalty_hessian(k_global * lambda_air_mesh, x, triplets, project);
+	}
+}
+
+void SimulationMesh::hessian_diagonal(const VectorX &x, VectorX &diag) const {
+	const CompiledMesh &mesh = compiled();
+
+	VectorX pos;
+	mesh.gather(x, pos);
+	diag = VectorX::Zero(x.size());
+
+	// bending, only the grad_theta grad_theta^T part of the hessian, which is positive
+	auto add_bending_diagonal = [&](const CompiledMesh::Bend &bend) {
+		Vector6 corner;
+		corner <<
+			pos.segment<2>(2*bend.a),
+			pos.segment<2>(2*bend.b),
+			pos.segment<2>(2*bend.c);
+
+		Vector6 grad_theta;
+		real theta = angle(corner, &grad_theta);
+		if (std::abs(theta-M_PI) < 1e-6) {
+			grad_theta = signed_angle_gradient(corner);
+		}
+
+		real fac = 2*k_global*k_bend*bend.weight;
+		int i = 0;
+		for (int v : {bend.a, bend.b, bend.c}) {
+			if (mesh.movable(v)) {
+				diag.segment<2>(2*v) += fac * grad_theta.segment<2>(2*i).cwiseAbs2();
+			}
+			i++;
+		}
+	};
+	for (auto &bend : mesh.bends) {
+		add_bending_diagonal(bend);
+	}
+	for (auto &bend : mesh.connection_bends) {
+		add_bending_diagonal(bend);
+	}
+
+	// membrane, diagonal of the projected block k, the same for both ends
+	for (auto &seg : mesh.membranes) {
+		Vector2 d = pos.segment<2>(2*seg.b) - pos.segment<2>(2*seg.a);
+		real h = d.norm();
+		Vector2 nn = (d / h).cwiseAbs2();
+		real stretch = max(0., (h-seg.length)/h);
+		Vector2 k = 2*k_global*lambda_membrane * (nn + stretch * (Vector2::Ones() - nn));
+		for (int v : {seg.a, seg.b}) {
+			if (mesh.movable(v)) {
+				diag.segment<2>(2*v) += k;
+			}
+		}
+	}
+
+	// the penalty is bilinear in each face with zero diagonal blocks
+	if (air_mesh_barrier) {
+		air_mesh.barrier_hessian_diagonal(k_global * lambda_air_mesh, x, diag);
+	}
+}
+
+real SimulationMesh::max_step(const VectorX &x, const VectorX &dx) const {
+	if (!air_mesh_barrier || air_mesh.empty()) {
+		return 1.;
+	}
+	return air_mesh.max_step(x, dx);
+}
+
 void SimulationMesh::verify() {
 
 	for (auto it = vertices.begin(); it != vertices.end(); ++it) {
@@ -296,6 +579,9 @@ void SimulationMesh::verify() {
 void SimulationMesh::generate_air_mesh() {
 	air_mesh = AirMesh(*this);
 	dbg(air_mesh.cdt.number_of_faces());
+	if (air_mesh_barrier) {
+		air_mesh.update_inverted(x);
+	}
 }
 
 bool SimulationMesh::relax_air_mesh() {
@@ -304,8 +590,14 @@ bool SimulationMesh::relax_air_mesh() {
 	}
 
 	assert(vertices.size() == air_mesh.vertices.size());
+	assert(staged_x.empty());
 
-	return air_mesh.relax(x);
+	bool changed = air_mesh.relax(x);
+	if (air_mesh_barrier) {
+		// switch inverted faces to the penalty and untangled ones back to the barrier
+		changed |= air_mesh.update_inverted(x);
+	}
+	return changed;
 }
 
 SimulationMesh SimulationMesh::generate_horizontal_strip(real length, real h) {
@@ -321,6 +613,7 @@ SimulationMesh SimulationMesh::generate_horizontal_strip(real length, real h) {
 }
 
 int SimulationMesh::dof() const {
+	assert(staged_x.empty());
 	return x.size();
 }
 
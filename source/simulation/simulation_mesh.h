@@ -4,6 +4,7 @@
 #include <variant>
 #include "common/clone_helper.h"
 #include "simulation/air_mesh.h"
+#include "simulation/compiled_mesh.h"
 
 #include <igl/serialize.h>
 
@@ -42,8 +43,8 @@ public:
 	VectorX x;
 	VectorX m;
 
-	list<Vertex> vertices;
-	list<Segment> segments;
+	Arena<Vertex> vertices;
+	Arena<Segment> segments;
 	vector<array<listref<Segment>, 2>> connection_bends;
 
 	vector<pair<listref<Vertex>, real>> extra_mass;
@@ -56,6 +57,9 @@ public:
 	real density = 0.080; // 80 g
 	real lambda_membrane = 5e5; // ???
 	real lambda_air_mesh = 1e4; // ???
+	/// keep the air mesh from inverting with a log barrier instead of a linear penalty,
+	/// needs simulators that limit their steps with max_step(). Faces that are already inverted keep the penalty.
+	bool air_mesh_barrier = false;
 	Vector2 gravity = Vector2(0.,-981.);
 
 	Vector2 lb = Vector2(-infinity, 0.);
@@ -64,14 +68,49 @@ public:
 	static SimulationMesh generate_horizontal_strip(real length, real h);
 
 	real energy(const VectorX &x, VectorX *grad) const;
+	/// number of energy() calls, for profiling
+	mutable int energy_evaluations = 0;
+	/// Hessian of energy() as triplets in x, optionally with every element hessian projected to be positive semi-definite.
+	/// The triplet order only depends on the topology (segments, bends and air mesh faces), not on x or project:
+	/// air mesh faces away from contact add zero blocks. Newton still compares the pattern before reusing it.
+	void hessian(const VectorX &x, vector<Eigen::Triplet<real>> &triplets, bool project = true) const;
+	/// Positive diagonal approximating that of hessian(x, triplets, true) without building an element hessian:
+	/// Gauss-Newton for the bending angles, the projected membrane and barrier terms. For diagonal scaling.
+	void hessian_diagonal(const VectorX &x, VectorX &diag) const;
+	/// Largest fraction of the step dx from x that keeps every air mesh triangle positive, 1 without the barrier.
+	real max_step(const VectorX &x, const VectorX &dx) const;
+
+	/// Flat index arrays used by energy(), rebuilt lazily after invalidate_compiled().
+	/// Anything that changes vertices, segments, bends, masses or widths must invalidate.
+	const CompiledMesh &compiled() const;
+	void invalidate_compiled();
 	Vector2 get_vertex_position(Vertex &v) const;
 
+	/// Scope for adding many vertices at once: movable vertices are staged and x and m are resized
+	/// once by finish() or the destructor, instead of for every vertex. Builders nest, only the
+	/// outermost one resizes. Until then only get_vertex_position knows the staged vertices.
+	class Builder {
+	public:
+		/// optionally reserve room for the given number of new vertices and segments
+		Builder(SimulationMesh &mesh, int vertices = 0, int segments = 0);
+		~Builder();
+		Builder(const Builder &) = delete;
+		Builder &operator=(const Builder &) = delete;
+
+		void finish();
+	private:
+		SimulationMesh &mesh;
+		bool finished = false;
+	};
+
 	listref<Vertex> push_vertex(Vector2 position, bool fixed = false);
 	listref<Segment> push_segment(listref<Vertex> a, listref<Vertex> b, real length);
 	listref<Segment> insert_segment(listref<Vertex> a, listref<Vertex> b, real length, listref<Segment> position);
 	array<listref<Segment>,2> split_segment(listref<Segment> seg);
 
 	void generate_air_mesh();
+	/// Flip edges of the air mesh and, with the barrier, update AirMesh::inverted.
+	/// Returns whether the energy changed, so that the simulator has to run again.
 	bool relax_air_mesh();
 
 	bool consistent_lengths() const;
@@ -82,26 +121,45 @@ public:
 
 	/// Remove vertices that are not referenced by any segment
 	/// Also remove unneeded degrees of freedom from unused entries of x
-	void cleanup();
+	/// Returns the new index of every movable vertex, -1 if it was removed
+	vector<int> cleanup();
 	void update_vertex_mass();
 
 	void verify();
 
 	real total_mass() const;
 
+private:
+	mutable CompiledMesh _compiled;
+	mutable bool _compiled_valid = false;
+
+	void compile() const;
+	/// push_vertex without discarding the air mesh
+	listref<Vertex> add_vertex(Vector2 position, bool fixed = false);
+
+	/// open Builders and the positions of the vertices they staged
+	int builders = 0;
+	vector<real> staged_x;
+
+public:
+
 	template<typename Tr>
 	SimulationMesh clone(Tr &tr) { // const
 		SimulationMesh res;
 		res.x = x;
+		res.m = m;
+		res.k_global = k_global;
 		res.k_bend = k_bend;
+		res.density = density;
 		res.lambda_membrane = lambda_membrane;
 		res.lambda_air_mesh = lambda_air_mesh;
+		res.air_mesh_barrier = air_mesh_barrier;
 		res.gravity = gravity;
 		res.lb = lb;
 		res.ub = ub;
 
-		tr.transform(vertices.begin(), vertices.end(), res.vertices, [&](Vertex x){return x;});
-		tr.transform(segments.begin(), segments.end(), res.segments, [&](Segment seg){
+		tr.transform(vertices, res.vertices, [&](Vertex x){return x;});
+		tr.transform(segments, res.segments, [&](Segment seg){
 			return Segment(tr(seg.start), tr(seg.end), seg.length);
 		});
 		std::transform(connection_bends.begin(), connection_bends.end(), std::back_inserter(res.connection_bends), [&](array<listref<Segment>, 2> x) {
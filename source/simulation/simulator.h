@@ -6,9 +6,22 @@ namespace ruffles::simulation {
 
 class Simulator {
 public:
+	virtual ~Simulator() = default;
+
 	virtual void reset(const SimulationMesh &) {
 	}
+	/// Called instead of reset() to continue from the state of the previous solve.
+	/// Degrees of freedom added since then start from rest.
+	virtual void warm_start(const SimulationMesh &mesh) {
+		reset(mesh);
+	}
+	/// The movable vertices were renumbered, vertex i is now new_index[i] (-1 if removed)
+	virtual void remap(const vector<int> &) {}
 	virtual bool step(SimulationMesh &) = 0;
+	/// Most step() calls of one physics solve
+	virtual int max_steps() const {
+		return 1000;
+	}
 
 	virtual void menu_callback() {}
 };
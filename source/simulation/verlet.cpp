@@ -2,6 +2,8 @@
 
 #include "common/imgui.h"
 
+#include <algorithm>
+
 namespace ruffles::simulation {
 
 Verlet::Verlet(const SimulationMesh &mesh) {
@@ -13,6 +15,31 @@ void Verlet::reset(const SimulationMesh &mesh) {
 	grad = VectorX::Zero(mesh.dof());
 }
 
+void Verlet::warm_start(const SimulationMesh &mesh) {
+	if (vel.size() > mesh.dof()) {
+		// vertices were removed without a remap, the velocities can't be matched anymore
+		reset(mesh);
+		return;
+	}
+	// new vertices are appended at the end of x
+	int old_size = vel.size();
+	vel.conservativeResize(mesh.dof());
+	vel.tail(mesh.dof()-old_size).setZero();
+	grad = VectorX::Zero(mesh.dof());
+}
+
+void Verlet::remap(const vector<int> &new_index) {
+	int n = std::count_if(new_index.begin(), new_index.end(), [](int i) { return i >= 0; });
+	VectorX new_vel = VectorX::Zero(2*n);
+	for (int i = 0; i < (int)new_index.size() && 2*i < vel.size(); i++) {
+		if (new_index[i] >= 0) {
+			new_vel.segment<2>(2*new_index[i]) = vel.segment<2>(2*i);
+		}
+	}
+	vel = new_vel;
+	grad = VectorX::Zero(2*n);
+}
+
 bool Verlet::step(SimulationMesh &mesh) {
 	grad.setZero();
 	VectorX &pos = mesh.x;
@@ -25,32 +52,33 @@ bool Verlet::step(SimulationMesh &mesh) {
 
 	// modified verlet scheme using a single evaluation
 	vel += dt * (gamma) * acc;
-	pos += dt * vel + dt*dt * 0.5 * acc;
-	vel += dt * (1-gamma) * acc;
-
+	VectorX dx = dt * vel + dt*dt * 0.5 * acc;
 
-	for (int i = 0; i < pos.size(); i += 2) {
-		if (pos(i) < mesh.lb(0)) {
-			pos(i) = mesh.lb(0);
-			vel(i) = 0.;
-		}
-		if (pos(i) > mesh.ub(0)) {
-			pos(i) = mesh.ub(0);
+	// clamp the target first, so that the collision check sees the actual path
+	VectorXb clamped(pos.size());
+	for (int i = 0; i < pos.size(); i++) {
+		int d = i % 2;
+		real target = max(mesh.lb(d), min(mesh.ub(d), pos(i) + dx(i)));
+		clamped(i) = target != pos(i) + dx(i);
+		dx(i) = target - pos(i);
+	}
+	real t = mesh.max_step(pos, dx);
+	pos += t * dx;
+	vel += dt * (1-gamma) * acc;
+	for (int i = 0; i < pos.size(); i++) {
+		if (clamped(i)) {
 			vel(i) = 0.;
 		}
-		if (pos(i+1) < mesh.lb(1)) {
-			pos(i+1) = mesh.lb(1);
-			vel(i+1) = 0.;
-		}
-		if (pos(i+1) > mesh.ub(1)) {
-			pos(i+1) = mesh.ub(1);
-			vel(i+1) = 0.;
-		}
+	}
+	if (t < 1.) {
+		// stopped in front of an air mesh triangle
+		vel.setZero();
 	}
 
 	vel *= damp;
 
-	bool converged = acc.squaredNorm() + vel.squaredNorm() < pos.size() * epsilon;
+	// a blocked step is no equilibrium
+	bool converged = t > 0. && acc.squaredNorm() + vel.squaredNorm() < pos.size() * epsilon;
 
 	if (mesh.relax_air_mesh()) {
 		return false;
@@ -9,7 +9,9 @@ class Verlet : public Simulator {
 public:
 	Verlet(const SimulationMesh &mesh);
 
-	virtual void reset(const SimulationMesh &mesh);
+	virtual void reset(const SimulationMesh &mesh) override;
+	virtual void warm_start(const SimulationMesh &mesh) override;
+	virtual void remap(const vector<int> &new_index) override;
 
 	virtual bool step(SimulationMesh &mesh) override;
 